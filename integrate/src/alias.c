@@ -0,0 +1,84 @@
+#include "alias.h"
+
+/* build the table using Vose's variant of the alias method.  the
+   "small" and "large" worklists share one scratch array, growing
+   towards each other from either end; between them they never hold
+   more than n entries. */
+void alias_init(AliasTable *t, float *w, int n)
+{
+  int i, s, l, nsmall, nlarge;
+  int *work;
+  double wsum, p;
+
+  wsum = 0.0;
+  for (i=0; i<n; i++)
+    wsum += w[i];
+
+  if (!(wsum > 0.0))
+    ath_error("[alias_init]: weights sum to %e\n", wsum);
+
+  t->n     = n;
+  t->prob  = w;
+  t->alias = (int*) calloc_1d_array(n, sizeof(int));
+  work     = (int*) calloc_1d_array(n, sizeof(int));
+
+  /* scale so that the mean weight is 1 and sort into the worklists */
+  nsmall = nlarge = 0;
+  for (i=0; i<n; i++) {
+    t->prob[i] = w[i] * (n / wsum);
+    t->alias[i] = i;
+
+    if (t->prob[i] < 1.0)
+      work[nsmall++] = i;
+    else
+      work[n-1 - nlarge++] = i;
+  }
+
+  /* pair each small column with a large one to fill it up to 1 */
+  while (nsmall > 0 && nlarge > 0) {
+    s = work[--nsmall];
+    l = work[n - nlarge--];
+
+    t->alias[s] = l;
+    p = ((double) t->prob[l] + t->prob[s]) - 1.0;
+    t->prob[l] = p;
+
+    if (p < 1.0)
+      work[nsmall++] = l;
+    else
+      work[n-1 - nlarge++] = l;
+  }
+
+  /* whatever is left is full, up to round-off */
+  while (nsmall > 0)
+    t->prob[work[--nsmall]] = 1.0;
+  while (nlarge > 0)
+    t->prob[work[n - nlarge--]] = 1.0;
+
+  free_1d_array((void*) work);
+
+  return;
+}
+
+
+void alias_free(AliasTable *t)
+{
+  if (t->prob != NULL)  free_1d_array((void*) t->prob);
+  if (t->alias != NULL) free_1d_array((void*) t->alias);
+
+  t->prob  = NULL;
+  t->alias = NULL;
+  t->n     = 0;
+
+  return;
+}
+
+
+int alias_draw(AliasTable *t, double u1, double u2)
+{
+  int i = (int) (u1 * t->n);
+
+  i = MIN(i, t->n-1);
+
+  return (u2 < t->prob[i]) ? i : t->alias[i];
+}
@@ -0,0 +1,25 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stdlib.h>
+#include "defs.h"
+#include "ath_array.h"
+
+/* Walker's alias method: after an O(n) setup, draws an integer in
+   [0, n) with probability proportional to a set of weights in O(1)
+   time, using two uniform deviates per draw. */
+typedef struct AliasTable_s{
+  int n;
+  float *prob;                  /* probability of keeping column i */
+  int *alias;                   /* where to go otherwise */
+}AliasTable;
+
+/* build a table from the n weights in w.  the table takes ownership
+   of w and overwrites it; release it with alias_free(). */
+void alias_init(AliasTable *t, float *w, int n);
+void alias_free(AliasTable *t);
+
+/* u1 and u2 are independent uniform deviates in [0,1] */
+int alias_draw(AliasTable *t, double u1, double u2);
+
+#endif
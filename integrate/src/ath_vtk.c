@@ -1,79 +1,153 @@
+#include <math.h>
 #include "ath_vtk.h"
+#include "numa.h"
+#include "vti.h"
 
 static int big_endian_flag = 0;
 
 
-void read_scalar(FILE *fp, char *label)
+/* the region of interest, in physical units, and how many cells
+   around it to read as well (see vtk_roi()) */
+static int    roi_set = 0;
+static double roi_x[2][3];
+static int    roi_margin;
+
+/* the rms of each vector array (in vtk_fields() order) over the whole
+   box, as given in the input file; 0 if it wasn't */
+static double roi_rms[MAXFIELD];
+
+
+/* read n floats from fp into row, in our byte order */
+static void read_floats(FILE *fp, int n, float *row, char *label)
 {
-  float ***dum;
-  int i, j, k, nread;
+  int i;
   union Float_u dat;
 
-  /* allocate space for the array */
-  dum = (float***)calloc_3d_array(Nz, Ny, Nx, sizeof(float));
+  if (fread(row, sizeof(float), n, fp) != (size_t) n)
+    ath_error("[vtkread]: Error reading %s\n", label);
 
-  for(k=0; k<Nz; k++) {
-    for(j=0; j<Ny; j++) {
-      for(i=0; i<Nx; i++) {
-        if ((nread = fread(&(dat.f), sizeof(float), 1, fp)) != 1)
-          ath_error("[read_scalar]: Error reading %s\n",label);
-
-        /* VTK BINARY files are defined to be big-endian */
-        if (!big_endian_flag) dat.i = Flip_int32(dat.i);
-        dum[k][j][i] = dat.f;
-     }
+  /* VTK BINARY files are defined to be big-endian */
+  if (!big_endian_flag) {
+    for (i=0; i<n; i++) {
+      dat.f = row[i];
+      dat.i = Flip_int32(dat.i);
+      row[i] = dat.f;
     }
   }
 
-  if (strcmp(label,"specific_scalar[0]") == 0)
-    dye = dum;
-  else
-    ath_error("[read_scalar]: Unknown scalar label: %s\n", label);
+  return;
+}
+
+
+/* read row (j, k) of B, m floats per cell, from an array which
+   starts at offset start in fp.  rows are read one after the other
+   unless only part of the file is wanted; then the ones in between
+   are skipped over. */
+static void read_row(FILE *fp, long start, int m, int j, int k,
+                     float *row, char *label)
+{
+  if (roi_cut &&
+      fseek(fp, start + (long) m*sizeof(float) *
+            (((long) (k+Koff)*Ny_all + j+Joff)*Nx_all + Ioff),
+            SEEK_SET) != 0)
+    ath_error("[read_row]: Error seeking in %s\n", label);
+
+  read_floats(fp, m*Nx, row, label);
 
   return;
 }
 
 
-void read_vector(FILE *fp, char *label)
+void read_scalar(FILE *fp, char *label)
 {
-  Real3Vect ***dum;
-  int i, j, k, nread;
-  union Float_u dat;
+  float ***dum, *row;
+  int i, j, k;
+  long start;
 
-  /* allocate space for the arrays */
-  dum = (Real3Vect***)calloc_3d_array(Nz, Ny, Nx, sizeof(Real3Vect));
+  /* allocate space for the array */
+  dum = (float***)calloc_3d_array_numa(Nz, Ny, Nx, sizeof(float));
+  row = (float*) calloc_1d_array(Nx, sizeof(float));
 
+  start = ftell(fp);
   for(k=0; k<Nz; k++) {
     for(j=0; j<Ny; j++) {
-      for(i=0; i<Nx; i++) {
-        if ((nread = fread(&(dat.f), sizeof(float), 1, fp)) != 1)
-          ath_error("[read_vector]: Error reading %s\n",label);
+      read_row(fp, start, 1, j, k, row, label);
+      for(i=0; i<Nx; i++)
+        dum[k][j][i] = row[i];
+    }
+  }
+  if (roi_cut)
+    fseek(fp, start + (long) sizeof(float)*Nx_all*Ny_all*Nz_all, SEEK_SET);
+
+  free_1d_array((void*) row);
+
+  vtk_keep(label, 0, (void***) dum, 0.0);
+
+  return;
+}
+
 
-        /* VTK BINARY files are defined to be big-endian */
-        if (!big_endian_flag) dat.i = Flip_int32(dat.i);
-        dum[k][j][i].x1 = dat.f;
+/* vectors are read like scalars, but with an roi, normalize_B()
+   needs their rms over the whole box (see ath_vtk.h).  unless it was
+   given, every row of the file is read for it, and only the roi's
+   cells are kept. */
+void read_vector(FILE *fp, char *label)
+{
+  Real3Vect ***dum, *v;
+  float *row;
+  int i, j, k, whole;
+  long start;
+  double rms, sum2;
 
-        if ((nread = fread(&(dat.f), sizeof(float), 1, fp)) != 1)
-          ath_error("[read_vector]: Error reading %s\n",label);
+  rms = vtk_given_rms(label);
+  whole = (roi_cut && rms == 0.0);
+
+  /* allocate space for the arrays */
+  dum = (Real3Vect***)calloc_3d_array_numa(Nz, Ny, Nx, sizeof(Real3Vect));
+  row = (float*) calloc_1d_array(3*Nx_all, sizeof(float));
+
+  start = ftell(fp);
+  sum2 = 0.0;
+  for(k=0; k<Nz_all; k++) {
+    for(j=0; j<Ny_all; j++) {
+      if (k < Koff || k >= Koff+Nz || j < Joff || j >= Joff+Ny) {
+        if (!whole)
+          continue;
+        read_floats(fp, 3*Nx_all, row, label);
+      } else if (whole) {
+        read_floats(fp, 3*Nx_all, row, label);
+      } else {
+        read_row(fp, start, 3, j-Joff, k-Koff, row + 3*Ioff, label);
+      }
 
-        /* VTK BINARY files are defined to be big-endian */
-        if (!big_endian_flag) dat.i = Flip_int32(dat.i);
-        dum[k][j][i].x2 = dat.f;
+      if (whole) {
+        for(i=0; i<Nx_all; i++)
+          sum2 += (SQR((double) row[3*i]) +
+                   SQR((double) row[3*i+1]) +
+                   SQR((double) row[3*i+2]));
+      }
 
-        if ((nread = fread(&(dat.f), sizeof(float), 1, fp)) != 1)
-          ath_error("[read_vector]: Error reading %s\n",label);
+      if (k < Koff || k >= Koff+Nz || j < Joff || j >= Joff+Ny)
+        continue;
 
-        /* VTK BINARY files are defined to be big-endian */
-        if (!big_endian_flag) dat.i = Flip_int32(dat.i);
-        dum[k][j][i].x3 = dat.f;
+      v = dum[k-Koff][j-Joff];
+      for(i=0; i<Nx; i++) {
+        v[i].x1 = row[3*(i+Ioff)];
+        v[i].x2 = row[3*(i+Ioff)+1];
+        v[i].x3 = row[3*(i+Ioff)+2];
       }
     }
   }
+  if (roi_cut && !whole)
+    fseek(fp, start + (long) 3*sizeof(float)*Nx_all*Ny_all*Nz_all, SEEK_SET);
 
-  if (strcmp(label,"cell_centered_B") == 0)
-    B = dum;
-  else
-    ath_error("[read_vector]: Unknown vector label: %s\n",label);
+  free_1d_array((void*) row);
+
+  if (whole) {
+    rms = sqrt(sum2 / ((double) Nx_all*Ny_all*Nz_all));
+    vtk_found_rms(label, rms);
+  }
+  vtk_keep(label, 1, (void***) dum, rms);
 
   return;
 }
@@ -88,13 +162,73 @@ int is_big_endian(void)
 }
 
 
-void vtkread(FILE *fp)
+/* split a comma-separated list of labels into list[], which gets
+   fresh copies; returns how many there were.  caller names the
+   function asking, for the error message. */
+int vtk_names(char *names, char **list, int max, char *caller)
 {
-  int cell_dat;
-  char line[256], scvec[64], label[64], precision[64];
-  int retval;
+  char *c, *end;
+  int n, len;
+
+  for (c=names, n=0; *c != '\0'; c = (*end == ',') ? end+1 : end) {
+    end = strchr(c, ',');
+    if (end == NULL)
+      end = c + strlen(c);
+    if (end == c)
+      continue;
+
+    if (n == max)
+      ath_error("[%s]: more than %d labels in %s\n", caller, max, names);
+
+    len = (int) (end - c);
+    list[n] = (char*) calloc_1d_array(len+1, sizeof(char));
+    strncpy(list[n], c, len);
+    n++;
+  }
 
-  big_endian_flag = is_big_endian();
+  return n;
+}
+
+
+/* choose the VECTORS arrays to read, as a comma-separated list of
+   labels (e.g. "cell_centered_B,velocity") */
+void vtk_fields(char *names)
+{
+  int n;
+
+  for (n=0; n<nfield; n++)
+    free(field_name[n]);
+
+  nfield = vtk_names(names, field_name, MAXFIELD, "vtk_fields");
+  for (n=0; n<nfield; n++)
+    field[n] = NULL;
+
+  return;
+}
+
+
+/* the same for SCALARS arrays (e.g. "density,pressure") */
+void vtk_scalars(char *names)
+{
+  int n;
+
+  for (n=0; n<nscalar; n++)
+    free(scalar_name[n]);
+
+  nscalar = vtk_names(names, scalar_name, MAXSCALAR, "vtk_scalars");
+  for (n=0; n<nscalar; n++)
+    scalar[n] = NULL;
+
+  return;
+}
+
+
+/* read the header of a vtk file, up to and including CELL_DATA.  n
+   gets the number of cells (not corners) in each direction. */
+void vtk_header(FILE *fp, int *n, double *origin, double *spacing)
+{
+  int cell_dat;
+  char line[256];
 
   /* get header */
   fgets(line,256,fp);
@@ -120,27 +254,263 @@ void vtkread(FILE *fp)
   /* I'm assuming from this point on that the header is in good shape */
 
   /* Dimensions */
-  fscanf(fp,"DIMENSIONS %d %d %d\n",&(Nx),&(Ny),&(Nz));
+  fscanf(fp,"DIMENSIONS %d %d %d\n",&(n[0]),&(n[1]),&(n[2]));
 
   /* We want to store the number of grid cells, not the number of grid
      cell corners */
-  if(Nx > 1) Nx--;
-  if(Ny > 1) Ny--;
-  if(Nz > 1) Nz--;
+  if(n[0] > 1) n[0]--;
+  if(n[1] > 1) n[1]--;
+  if(n[2] > 1) n[2]--;
 
   /* Origin */
-  fscanf(fp,"ORIGIN %le %le %le\n",&ox,&oy,&oz);
+  fscanf(fp,"ORIGIN %le %le %le\n",&origin[0],&origin[1],&origin[2]);
 
   /* Spacing, dx, dy, dz */
-  fscanf(fp,"SPACING %le %le %le\n",&dx,&dy,&dz);
+  fscanf(fp,"SPACING %le %le %le\n",&spacing[0],&spacing[1],&spacing[2]);
 
   /* Cell Data = Nx*Ny*Nz */
   fscanf(fp,"CELL_DATA %d\n",&cell_dat);
-  if(cell_dat != Nx*Ny*Nz){
+  if(cell_dat != n[0]*n[1]*n[2]){
     ath_error("[vtkread]: Nx*Ny*Nz = %d\t cell_dat = %d\n",
-              Nx*Ny*Nz, cell_dat);
+              n[0]*n[1]*n[2], cell_dat);
+  }
+
+  return;
+}
+
+
+/* read only the cells within margin cells of lo < x < hi (in
+   physical units; a side can be +-HUGE_VAL to take the whole of it)
+   from now on, and stop lines at the edge of that region */
+void vtk_roi(double *lo, double *hi, int margin)
+{
+  int c;
+
+  for (c=0; c<3; c++) {
+    roi_x[0][c] = lo[c];
+    roi_x[1][c] = hi[c];
+  }
+  roi_margin = MAX(margin, 0);
+  roi_set = 1;
+
+  return;
+}
+
+
+/* the rms of each vector array over the whole box, as a
+   comma-separated list in vtk_fields() order (0 for one which isn't
+   known), so that an roi needn't read the rest of the box for them */
+void vtk_roi_rms(char *list)
+{
+  char *val[MAXFIELD];
+  int f, n;
+
+  n = vtk_names(list, val, MAXFIELD, "vtk_roi_rms");
+  for (f=0; f<MAXFIELD; f++)
+    roi_rms[f] = (f < n) ? atof(val[f]) : 0.0;
+  for (f=0; f<n; f++)
+    free_1d_array((void*) val[f]);
+
+  return;
+}
+
+
+/* the rms of the vector array called label, if it was given and an
+   roi is being read; else 0 */
+double vtk_given_rms(char *label)
+{
+  int f;
+
+  for (f=0; f<nfield; f++)
+    if (strcmp(label, field_name[f]) == 0)
+      return roi_cut ? MAX(roi_rms[f], 0.0) : 0.0;
+
+  return 0.0;
+}
+
+
+/* a reader worked the rms of label out from the whole box: say so,
+   so that it can be given next time */
+void vtk_found_rms(char *label, double rms)
+{
+  printf("[vtkread]: rms of %s over the whole box is %.17g; give it as "
+         "b_rms in <roi> to read only the roi\n", label, rms);
+
+  return;
+}
+
+
+/* B is the whole grid (see ath_vtk.h) */
+void vtk_whole(void)
+{
+  Ioff = Joff = Koff = 0;
+  Nx_all = Nx;  Ny_all = Ny;  Nz_all = Nz;
+
+  roi_lo[0] = roi_lo[1] = roi_lo[2] = 0.0;
+  roi_hi[0] = Nx-1;
+  roi_hi[1] = Ny-1;
+  roi_hi[2] = Nz-1;
+  roi_cut = 0;
+
+  return;
+}
+
+
+/* is the array called label one of those asked for?  vector says
+   whether it's a VECTORS array or a SCALARS one */
+int vtk_wanted(char *label, int vector)
+{
+  int f;
+
+  if (vector) {
+    for (f=0; f<nfield; f++)
+      if (strcmp(label, field_name[f]) == 0) return 1;
+  } else {
+    for (f=0; f<nscalar; f++)
+      if (strcmp(label, scalar_name[f]) == 0) return 1;
+    if (strcmp(label,"specific_scalar[0]") == 0) return 1;
+  }
+
+  return 0;
+}
+
+
+/* file an array which has just been read under its label; for
+   vectors, rms is its rms over the whole box, if B was cut down to an
+   roi */
+void vtk_keep(char *label, int vector, void ***dum, double rms)
+{
+  int i;
+
+  if (vector) {
+    for (i=0; i<nfield; i++) {
+      if (strcmp(label, field_name[i]) == 0) {
+        field[i] = (Real3Vect***) dum;
+        field_rms[i] = rms;
+        return;
+      }
+    }
+    ath_error("[vtk_keep]: Unknown vector label: %s\n",label);
+  }
+
+  if (strcmp(label,"specific_scalar[0]") == 0) {
+    dye = (float***) dum;
+    return;
+  }
+  for (i=0; i<nscalar; i++) {
+    if (strcmp(label, scalar_name[i]) == 0) {
+      scalar[i] = (float***) dum;
+      return;
+    }
+  }
+  ath_error("[vtk_keep]: Unknown scalar label: %s\n", label);
+
+  return;
+}
+
+
+/* after the arrays are read: were they all there? */
+void vtk_check(char *caller)
+{
+  int f;
+
+  for (f=0; f<nfield; f++)
+    if (field[f] == NULL)
+      ath_error("[%s]: no VECTORS %s in the file\n", caller, field_name[f]);
+  for (f=0; f<nscalar; f++)
+    if (scalar[f] == NULL)
+      ath_error("[%s]: no SCALARS %s in the file\n", caller, scalar_name[f]);
+  B = field[0];
+
+  return;
+}
+
+
+/* cut the grid of the file down to the cells around the region of
+   interest, and shift the origin to match */
+static void vtk_cut(void)
+{
+  int c, n[3], off[3], lo, hi;
+  double a, b, origin[3], spacing[3];
+
+  n[0] = Nx;  n[1] = Ny;  n[2] = Nz;
+  origin[0]  = ox;  origin[1]  = oy;  origin[2]  = oz;
+  spacing[0] = dx;  spacing[1] = dy;  spacing[2] = dz;
+
+  for (c=0; c<3; c++) {
+    /* the region, in cells of the file (clamped before the casts) */
+    a = (roi_x[0][c] - origin[c])/spacing[c];
+    b = (roi_x[1][c] - origin[c])/spacing[c];
+    a = MIN(MAX(a, 0.0), n[c]-1.0);
+    b = MIN(MAX(b, 0.0), n[c]-1.0);
+    if (b <= a)
+      ath_error("[vtkread]: the roi misses the grid in x%d\n", c+1);
+
+    lo = MAX((int) floor(a) - roi_margin, 0);
+    hi = MIN((int) ceil(b) + roi_margin + 1, n[c]);
+
+    off[c] = lo;
+    n[c] = hi - lo;
+    origin[c] += lo*spacing[c];
+    roi_lo[c] = a - lo;
+    roi_hi[c] = b - lo;
+  }
+
+  Ioff = off[0];  Joff = off[1];  Koff = off[2];
+  Nx = n[0];  Ny = n[1];  Nz = n[2];
+  ox = origin[0];  oy = origin[1];  oz = origin[2];
+  roi_cut = 1;
+
+  printf("[vtkread]: roi is cells %d..%d, %d..%d, %d..%d of %d x %d x %d\n",
+         Ioff, Ioff+Nx-1, Joff, Joff+Ny-1, Koff, Koff+Nz-1,
+         Nx_all, Ny_all, Nz_all);
+
+  return;
+}
+
+
+/* the grid of the file: n cells from origin, spacing apart.  B will
+   be all of it, or the part around the roi if there is one */
+void vtk_grid(int *n, double *origin, double *spacing)
+{
+  Nx = n[0];  Ny = n[1];  Nz = n[2];
+  ox = origin[0];  oy = origin[1];  oz = origin[2];
+  dx = spacing[0]; dy = spacing[1]; dz = spacing[2];
+
+  vtk_whole();
+  if (roi_set)
+    vtk_cut();
+  Klo = 0;
+  Khi = Nz;
+
+  return;
+}
+
+
+void vtkread(FILE *fp)
+{
+  int n[3], c, cell_dat;
+  double origin[3], spacing[3];
+  char line[256], scvec[64], label[64], precision[64];
+  int retval;
+
+  /* XML ImageData, rather than the legacy format? */
+  c = fgetc(fp);
+  ungetc(c, fp);
+  if (c == '<') {
+    vtiread(fp);
+    return;
   }
 
+  big_endian_flag = is_big_endian();
+
+  if (nfield == 0)
+    vtk_fields("cell_centered_B");
+
+  vtk_header(fp, n, origin, spacing);
+  cell_dat = n[0]*n[1]*n[2];
+  vtk_grid(n, origin, spacing);
+
   while(1)
   {
     /* Read the "(SCALARS/VECTORS) label precision" line */
@@ -153,13 +523,11 @@ void vtkread(FILE *fp)
                 label, precision);
     }
 
-    if (strcmp(scvec,"VECTORS") == 0
-        && strcmp(label,"cell_centered_B") == 0)
+    if (strcmp(scvec,"VECTORS") == 0 && vtk_wanted(label, 1))
     {
       read_vector(fp,label);
     }
-    else if (strcmp(scvec,"SCALARS") == 0
-             && strcmp(label,"specific_scalar[0]") == 0)
+    else if (strcmp(scvec,"SCALARS") == 0 && vtk_wanted(label, 0))
     {
       fgets(line,256,fp); /* LOOKUP_TABLE default */
       read_scalar(fp,label);
@@ -167,7 +535,7 @@ void vtkread(FILE *fp)
     else
     {
       if (strcmp(scvec,"VECTORS") == 0) {
-        fseek(fp, 3*Nx*Ny*Nz*sizeof(float), SEEK_CUR);
+        fseek(fp, 3L*cell_dat*sizeof(float), SEEK_CUR);
       }
       else if (strcmp(scvec,"SCALARS") == 0) {
         fgets(line,256,fp); /* LOOKUP_TABLE default */
@@ -178,14 +546,185 @@ void vtkread(FILE *fp)
     }
   }
 
+  vtk_check("vtkread");
+
   return;
 }
 
+/* read the part of the first field (cell_centered_B, unless
+   vtk_fields() said otherwise) in a vtk file which falls in
+   planes Klo <= k < Khi of a bigger grid, whose cell (ioff, joff,
+   koff) is the first cell of the file.  B must already point at
+   those planes.  everything else in the file is skipped, a plane at
+   a time so that the offsets stay small. */
+void vtkread_part(FILE *fp, int ioff, int joff, int koff)
+{
+  int n[3], i, j, k, m, np;
+  double origin[3], spacing[3];
+  char line[256], scvec[64], label[64], precision[64];
+  float *plane;
+  union Float_u dat;
+  int retval;
+
+  big_endian_flag = is_big_endian();
+
+  if (nfield == 0)
+    vtk_fields("cell_centered_B");
+
+  vtk_header(fp, n, origin, spacing);
+
+  np = n[0]*n[1];
+  plane = (float*) calloc_1d_array(3*np, sizeof(float));
+
+  while(1)
+  {
+    retval = fscanf(fp,"%s %s %s\n",scvec,label,precision);
+    if(retval == EOF) break;
+
+    if(strcmp(precision,"float") != 0){
+      ath_error("[vtkread_part]: Expected float precision for %s; found: %s\n",
+                label, precision);
+    }
+
+    if (strcmp(scvec,"SCALARS") == 0)
+      fgets(line,256,fp); /* LOOKUP_TABLE default */
+    else if (strcmp(scvec,"VECTORS") != 0)
+      ath_error("unknown type %s\n", scvec);
+
+    m = (strcmp(scvec,"VECTORS") == 0) ? 3 : 1;
+
+    for (k=0; k<n[2]; k++) {
+      if (strcmp(label, field_name[0]) != 0 ||
+          k+koff < Klo || k+koff >= Khi) {
+        fseek(fp, (long) m*np*sizeof(float), SEEK_CUR);
+        continue;
+      }
+
+      if (fread(plane, sizeof(float), 3*np, fp) != (size_t) 3*np)
+        ath_error("[vtkread_part]: Error reading %s\n", label);
+
+      /* VTK BINARY files are defined to be big-endian */
+      if (!big_endian_flag) {
+        for (i=0; i<3*np; i++) {
+          dat.f = plane[i];
+          dat.i = Flip_int32(dat.i);
+          plane[i] = dat.f;
+        }
+      }
+
+      for (j=0; j<n[1]; j++) {
+        for (i=0; i<n[0]; i++) {
+          B[k+koff][j+joff][i+ioff].x1 = plane[3*(j*n[0]+i)];
+          B[k+koff][j+joff][i+ioff].x2 = plane[3*(j*n[0]+i)+1];
+          B[k+koff][j+joff][i+ioff].x3 = plane[3*(j*n[0]+i)+2];
+        }
+      }
+    }
+  }
+
+  free_1d_array((void*) plane);
+
+  return;
+}
+
+
 void cleanup_vtk()
 {
+  int f;
+
+  for (f=0; f<nfield; f++) {
+    if (field[f] == B) B = NULL;
+    if (field[f] != NULL) free_3d_array((void ***)field[f]);
+    field[f] = NULL;
+  }
+
+  for (f=0; f<nscalar; f++) {
+    if (scalar[f] != NULL) free_3d_array((void ***)scalar[f]);
+    scalar[f] = NULL;
+  }
+
   if (B != NULL)   free_3d_array((void ***)B);
   if (dye != NULL) free_3d_array((void ***)dye);
 
+  B = NULL;
+  dye = NULL;
+
+  return;
+}
+
+
+/* the header of a legacy BINARY vtk file for the grid Nx, ox, dx... */
+void vtkwrite_header(FILE *fp, char *comment)
+{
+  fprintf(fp, "# vtk DataFile Version 3.0\n");
+  fprintf(fp, "%s\n", comment);
+  fprintf(fp, "BINARY\n");
+  fprintf(fp, "DATASET STRUCTURED_POINTS\n");
+  fprintf(fp, "DIMENSIONS %d %d %d\n", Nx+1, Ny+1, Nz+1);
+  fprintf(fp, "ORIGIN %e %e %e\n", ox, oy, oz);
+  fprintf(fp, "SPACING %e %e %e\n", dx, dy, dz);
+  fprintf(fp, "CELL_DATA %d\n", Nx*Ny*Nz);
+
+  return;
+}
+
+
+/* write B (and the dye, if there is one) as a legacy BINARY vtk file
+   in the same format vtkread() expects. */
+void vtkwrite(FILE *fp, char *comment)
+{
+  int i, j, k;
+  float *row;
+  union Float_u dat;
+
+  big_endian_flag = is_big_endian();
+
+  vtkwrite_header(fp, comment);
+
+  row = (float*) calloc_1d_array(3*Nx, sizeof(float));
+
+  fprintf(fp, "VECTORS cell_centered_B float\n");
+  for(k=0; k<Nz; k++) {
+    for(j=0; j<Ny; j++) {
+      for(i=0; i<Nx; i++) {
+        row[3*i]   = B[k][j][i].x1;
+        row[3*i+1] = B[k][j][i].x2;
+        row[3*i+2] = B[k][j][i].x3;
+      }
+
+      /* VTK BINARY files are defined to be big-endian */
+      if (!big_endian_flag) {
+        for (i=0; i<3*Nx; i++) {
+          dat.f = row[i];
+          dat.i = Flip_int32(dat.i);
+          row[i] = dat.f;
+        }
+      }
+
+      if (fwrite(row, sizeof(float), 3*Nx, fp) != (size_t) 3*Nx)
+        ath_error("[vtkwrite]: Error writing cell_centered_B\n");
+    }
+  }
+
+  if (dye != NULL) {
+    fprintf(fp, "SCALARS specific_scalar[0] float\n");
+    fprintf(fp, "LOOKUP_TABLE default\n");
+    for(k=0; k<Nz; k++) {
+      for(j=0; j<Ny; j++) {
+        for(i=0; i<Nx; i++) {
+          dat.f = dye[k][j][i];
+          if (!big_endian_flag) dat.i = Flip_int32(dat.i);
+          row[i] = dat.f;
+        }
+
+        if (fwrite(row, sizeof(float), Nx, fp) != (size_t) Nx)
+          ath_error("[vtkwrite]: Error writing specific_scalar[0]\n");
+      }
+    }
+  }
+
+  free_1d_array((void*) row);
+
   return;
 }
 
@@ -10,10 +10,49 @@
 Real3Vect ***B;
 float     ***dye;
 
+/* VECTORS arrays to read, in the order given to vtk_fields().  B
+   points at one of them: the first, unless the caller switches.  by
+   default only cell_centered_B is read. */
+#define MAXFIELD 8
+int        nfield;
+char      *field_name[MAXFIELD];
+Real3Vect ***field[MAXFIELD];
+double     field_rms[MAXFIELD];   /* over the whole box, with an roi */
+
+/* SCALARS arrays to read, in the order given to vtk_scalars().
+   specific_scalar[0] is always read, into dye, and never listed. */
+#define MAXSCALAR 8
+int        nscalar;
+char      *scalar_name[MAXSCALAR];
+float     ***scalar[MAXSCALAR];
+
 int    Nx, Ny, Nz;
 double ox, oy, oz; /* origin */
 double dx, dy, dz;
 
+/* planes of B held in memory, Klo <= k < Khi.  everything, unless
+   only a slab of the domain was read (see domain.h) */
+int    Klo, Khi;
+
+/* with an <roi>, only the cells of the file near a region of interest
+   are read (see vtk_roi()): B[k][j][i] is cell (i+Ioff, j+Joff,
+   k+Koff) of the Nx_all x Ny_all x Nz_all in the file.  lines stop at
+   the edge of the region itself, roi_lo < x < roi_hi in the cell
+   units of B, a margin short of what was read, and are written out in
+   units of the whole box, as if it had all been read.  otherwise the
+   offsets are 0, the file is all there is, and lines stop at 0 and
+   N-1, as always.  whatever loads B sets these.
+
+   normalize_B() scales the vectors by their rms over the whole box,
+   field_rms[], as a full read does.  given to vtk_roi_rms() (b_rms in
+   <roi>), only the roi is read; otherwise the vectors are still read
+   through in full to work it out, and the readers print it so that
+   it can be given next time.  scalars are only read in the roi. */
+int    Ioff, Joff, Koff;
+int    Nx_all, Ny_all, Nz_all;
+double roi_lo[3], roi_hi[3];
+int    roi_cut;                 /* B was cut down to an roi */
+
 
 #define Flip_int32(a)  ((((a) >> 24) & 0x000000ff) | (((a) >>  8) & 0x0000ff00) \
                         | (((a) <<  8) & 0x00ff0000) | (((a) << 24) & 0xff000000) )
@@ -28,7 +67,26 @@ union Float_u {
 void cc_pos(const int i, const int j,const int k,
             double *px1, double *px2, double *px3);
 
+int  vtk_names(char *names, char **list, int max, char *caller);
+void vtk_fields(char *names);
+void vtk_scalars(char *names);
+void vtk_header(FILE *fp, int *n, double *origin, double *spacing);
+void vtk_roi(double *lo, double *hi, int margin);
+void vtk_roi_rms(char *list);
+double vtk_given_rms(char *label);
+void vtk_found_rms(char *label, double rms);
+void vtk_whole(void);
+void vtk_grid(int *n, double *origin, double *spacing);
+int  vtk_wanted(char *label, int vector);
+void vtk_keep(char *label, int vector, void ***dum, double rms);
+void vtk_check(char *caller);
+
+/* reads legacy BINARY STRUCTURED_POINTS files, and XML ImageData
+   (.vti) ones, which it hands to vtiread() (see vti.h) */
 void vtkread(FILE *fp);
+void vtkread_part(FILE *fp, int ioff, int joff, int koff);
+void vtkwrite_header(FILE *fp, char *comment);
+void vtkwrite(FILE *fp, char *comment);
 void cleanup_vtk();
 
 void read_scalar(FILE *fp, char *label);
@@ -0,0 +1,377 @@
+/*==============================================================================
+ * FILE: bench.c
+ *
+ * PURPOSE: microbenchmarks for the hot paths of flines, run on the
+ *   analytic fields in synth.c at a few grid sizes.  Results are
+ *   written as JSON so runs on different commits can be compared.
+ *
+ * USAGE: ./flines_bench [-o bench.json] [n1 n2 ...]
+ *
+ *   the default grid sizes are 32, 64 and 128.  each kernel is
+ *   repeated until it has run for at least MIN_TIME seconds.
+ *============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+#include "rk4.h"
+#include "stats.h"
+#include "lines.h"
+#include "synth.h"
+
+#define MIN_TIME 0.25           /* seconds per measurement */
+#define NPOS     4096           /* random sample points per field */
+#define MAXSIZES 16
+
+static char *fields[] = {"uniform", "abc", "dipole", "tangled"};
+static int nfields = 4;
+
+static FILE *json;
+static int nresult = 0;
+
+/* keep the compiler from throwing the work away */
+static volatile double sink;
+
+
+/* one JSON record.  fields which don't apply to a kernel are < 0 and
+   left out.  rejected is the fraction of trial steps thrown away. */
+static void report(char *kernel, char *field, int n, long calls, double t,
+                   double lookups, double rejected, double bytes)
+{
+  fprintf(json, "%s\n    {\"kernel\": \"%s\", \"field\": \"%s\", \"n\": %d, "
+          "\"calls\": %ld, \"ns_per_call\": %.3f",
+          (nresult++ == 0) ? "" : ",", kernel, field, n, calls,
+          1.0e9*t/calls);
+
+  if (lookups >= 0.0)
+    fprintf(json, ", \"lookups_per_s\": %.6e", lookups/t);
+  if (rejected >= 0.0)
+    fprintf(json, ", \"rejected_ratio\": %.6f", rejected);
+  if (bytes >= 0.0)
+    fprintf(json, ", \"bytes_per_s\": %.6e", bytes/t);
+
+  fprintf(json, "}");
+
+  printf("%-14s %-8s %4d  %12.1f ns/call\n",
+         kernel, field, n, 1.0e9*t/calls);
+
+  return;
+}
+
+
+/* points well inside the box, where nothing gets clamped */
+static void random_points(Real3Vect *pos, int npos)
+{
+  int p;
+
+  for (p=0; p<npos; p++) {
+    pos[p].x1 = 1.0 + (Nx-3) * RandomReal();
+    pos[p].x2 = 1.0 + (Ny-3) * RandomReal();
+    pos[p].x3 = 1.0 + (Nz-3) * RandomReal();
+  }
+
+  return;
+}
+
+
+static void bench_interpolate(char *field, Real3Vect *pos)
+{
+  long calls = 0;
+  int p;
+  double t0, t;
+  Real3Vect val;
+
+  t0 = wall_time();
+  do {
+    for (p=0; p<NPOS; p++) {
+      interpolate_B(&pos[p], &val);
+      sink += val.x1;
+    }
+    calls += NPOS;
+  } while ((t = wall_time() - t0) < MIN_TIME);
+
+  report("interpolate_B", field, Nx, calls, t, (double) calls, -1.0, -1.0);
+
+  return;
+}
+
+
+static void bench_step(char *field, Real3Vect *pos)
+{
+  long calls = 0;
+  int p;
+  double t0, t;
+  Real3Vect xnp1;
+
+  t0 = wall_time();
+  do {
+    for (p=0; p<NPOS; p++) {
+      RK4_step(&pos[p], &xnp1, 0.5, 1);
+      sink += xnp1.x1;
+    }
+    calls += NPOS;
+  } while ((t = wall_time() - t0) < MIN_TIME);
+
+  report("RK4_step", field, Nx, calls, t, 4.0*calls, -1.0, -1.0);
+
+  return;
+}
+
+
+/* the step counters in stats.c give the number of field lookups and
+   rejected trial steps */
+static double rejected_ratio(Stats *before, Stats *after)
+{
+  long trials = (after->accepted + after->rejected
+                 - before->accepted - before->rejected);
+
+  return trials > 0 ? (double) (after->rejected - before->rejected) / trials : 0.0;
+}
+
+static double lookups(Stats *before, Stats *after)
+{
+  return (double) FIELD_LOOKUPS(after->accepted - before->accepted,
+                                after->rejected - before->rejected);
+}
+
+
+static void bench_qc_step(char *field, Real3Vect *pos)
+{
+  long calls = 0;
+  int p;
+  double t0, t, h_did, h_next;
+  Real3Vect xnp1;
+  Stats before, after;
+
+  stats_sum(&before);
+  t0 = wall_time();
+  do {
+    for (p=0; p<NPOS; p++) {
+      RK4_qc_step(&pos[p], &xnp1, 1.0, &h_did, &h_next, tolerance, 1, NULL);
+      sink += xnp1.x1;
+    }
+    calls += NPOS;
+  } while ((t = wall_time() - t0) < MIN_TIME);
+  stats_sum(&after);
+
+  report("RK4_qc_step", field, Nx, calls, t,
+         lookups(&before, &after), rejected_ratio(&before, &after), -1.0);
+
+  return;
+}
+
+
+static void reset_line(Real3Vect *xvals, Real3Vect *seed)
+{
+  int j;
+
+  for (j=0; j<maxstep; j++)
+    xvals[j].x1 = xvals[j].x2 = xvals[j].x3 = -1.0;
+  xvals[maxstep/2] = *seed;
+
+  return;
+}
+
+
+static void bench_integrate(char *field, Real3Vect *pos)
+{
+  long calls = 0;
+  int p = 0;
+  double t0, t = 0.0;
+  Real3Vect *xvals;
+  Stats before, after;
+
+  xvals = (Real3Vect*) calloc_1d_array(maxstep, sizeof(Real3Vect));
+
+  stats_sum(&before);
+  do {
+    reset_line(xvals, &pos[p++ % NPOS]);
+
+    t0 = wall_time();
+    RK4_integrate(xvals, NULL, NULL, 0.0, NULL);
+    t += wall_time() - t0;
+
+    calls++;
+  } while (t < MIN_TIME);
+  stats_sum(&after);
+
+  report("RK4_integrate", field, Nx, calls, t,
+         lookups(&before, &after), rejected_ratio(&before, &after), -1.0);
+
+  free_1d_array((void*) xvals);
+
+  return;
+}
+
+
+static void bench_line(char *field, Real3Vect *pos, Real3Vect **xvals)
+{
+  long calls = 0;
+  int p = 0, stop[2];
+  double t0, t = 0.0;
+  Stats before, after;
+
+  stats_sum(&before);
+  do {
+    reset_line(xvals[calls % nlines], &pos[p++ % NPOS]);
+
+    t0 = wall_time();
+    integrate_line(xvals[calls % nlines], NULL, (int) calls, stop);
+    t += wall_time() - t0;
+
+    calls++;
+  } while (t < MIN_TIME || calls < nlines);
+  stats_sum(&after);
+
+  report("integrate_line", field, Nx, calls, t,
+         lookups(&before, &after), rejected_ratio(&before, &after), -1.0);
+
+  return;
+}
+
+
+/* write the field to a scratch file and time reading it back.  the
+   file is in the page cache, so this measures parsing and byte
+   swapping rather than the disk. */
+static void bench_read(char *field)
+{
+  FILE *fp;
+  long calls = 0;
+  double t0, t = 0.0, bytes = 0.0;
+
+  if ((fp = tmpfile()) == NULL)
+    ath_error("[bench_read]: could not open a scratch file\n");
+
+  vtkwrite(fp, "flines_bench");
+
+  do {
+    cleanup_vtk();
+    rewind(fp);
+
+    t0 = wall_time();
+    vtkread(fp);
+    t += wall_time() - t0;
+
+    bytes += 3.0*sizeof(float)*Nx*Ny*Nz;
+    calls++;
+  } while (t < MIN_TIME);
+
+  fclose(fp);
+
+  report("read_vector", field, Nx, calls, t, -1.0, -1.0, bytes);
+
+  /* vtkread() leaves the field un-normalized */
+  normalize_B();
+
+  return;
+}
+
+
+static void bench_write(char *field, Real3Vect **xvals)
+{
+  FILE *fp;
+  char *fname = "flines_bench.tmp";
+  long calls = 0;
+  double t0, t = 0.0, bytes = 0.0;
+
+  do {
+    t0 = wall_time();
+    write_data(fname, xvals, NULL);
+    t += wall_time() - t0;
+
+    if ((fp = fopen(fname, "r")) == NULL)
+      ath_error("[bench_write]: could not reopen %s\n", fname);
+    fseek(fp, 0, SEEK_END);
+    bytes += ftell(fp);
+    fclose(fp);
+
+    calls++;
+  } while (t < MIN_TIME);
+
+  remove(fname);
+
+  report("write_data", field, Nx, calls, t, -1.0, -1.0, bytes);
+
+  return;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int i, f, s, nsizes = 0;
+  int sizes[MAXSIZES];
+  char *outname = "bench.json";
+  Real3Vect *pos, **xvals;
+
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+      outname = argv[++i];
+    else if (nsizes < MAXSIZES)
+      sizes[nsizes++] = atoi(argv[i]);
+  }
+
+  if (nsizes == 0) {
+    sizes[0] = 32;  sizes[1] = 64;  sizes[2] = 128;
+    nsizes = 3;
+  }
+
+  /* roughly the shipped input.fline, with a smaller bundle */
+  maxstep   = 20000;
+  tolerance = 1.0e-6;
+  xeno      = 1.0e-6;
+  close_lo  = 4.0;
+  close_hi  = 8.0;
+  nlines    = 16;
+  nbundle   = 10;
+  chaos_cut = 5.0;
+  tangent_cut = TANGENT_CUT;
+  d_test    = 0.0;
+
+  srand(-4);
+
+  if ((json = fopen(outname, "w")) == NULL)
+    ath_error("could not open %s\n", outname);
+
+  fprintf(json, "{\n  \"benchmark\": \"flines_bench\",\n");
+  fprintf(json, "  \"min_time\": %g,\n  \"results\": [", MIN_TIME);
+
+  pos   = (Real3Vect*) calloc_1d_array(NPOS, sizeof(Real3Vect));
+  xvals = (Real3Vect**) calloc_2d_array(nlines, maxstep, sizeof(Real3Vect));
+
+  for (s=0; s<nsizes; s++) {
+    for (f=0; f<nfields; f++) {
+      synth_field(fields[f], sizes[s]);
+      normalize_B();
+      RK4_init("rk4", "linear");
+
+      maxlen = 1.0 * Nx;
+      random_points(pos, NPOS);
+
+      bench_interpolate(fields[f], pos);
+      bench_step(fields[f], pos);
+      bench_qc_step(fields[f], pos);
+      bench_integrate(fields[f], pos);
+      bench_line(fields[f], pos, xvals);
+      bench_read(fields[f]);
+      bench_write(fields[f], xvals);
+
+      cleanup_vtk();
+    }
+  }
+
+  fprintf(json, "\n  ]\n}\n");
+  fclose(json);
+
+  printf("results written to %s\n", outname);
+
+  free_1d_array((void*) pos);
+  free_2d_array((void**) xvals);
+
+  return 0;
+}
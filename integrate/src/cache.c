@@ -0,0 +1,388 @@
+#include "cache.h"
+#include "lines.h"
+
+/* what is kept of each brick */
+typedef struct Brick_s{
+  unsigned long hash;           /* FNV-1a of the bytes of B */
+  float oct[8][4];              /* mean B and |B|^2 in each octant */
+}Brick;
+
+/* the start of a cache file.  it is only read back on the machine
+   which wrote it, so it's stored as is. */
+typedef struct CacheHead_s{
+  char magic[8];
+  int nx, ny, nz, brick, nlines, maxstep, nbundle, nmask;
+  int integrator;               /* see RK4_variant() */
+  int chaos;                    /* chaos_method */
+  double tolerance, chaos_cut, tangent_cut, close_lo, close_hi, maxlen;
+  double xeno, d_test;
+  unsigned long rng_seed;
+  long npts;                    /* points stored, over all lines */
+}CacheHead;
+
+#define CACHE_MAGIC "flcache4"
+
+/* this snapshot.  brick = 0 means there's no cache. */
+static int brick = 0;
+static int nbx, nby, nbz, nbrick, nmask;
+static double tol;
+static Brick *bricks = NULL;
+static unsigned char **visited = NULL; /* a bit per brick, per line */
+static int *stops = NULL;
+static int nreused;
+
+/* the previous one, if there is a usable cache file */
+static int loaded = 0;
+static char *same = NULL;       /* brick unchanged since then */
+static Real3Vect *old_seed = NULL, *old_pts = NULL;
+static unsigned char **old_visited = NULL;
+static int *old_stops = NULL, *old_first = NULL, *old_npts = NULL;
+static long *old_off = NULL;
+
+
+/* fill in the header for this run */
+static void cache_head(CacheHead *h)
+{
+  memset(h, 0, sizeof(CacheHead));
+  memcpy(h->magic, CACHE_MAGIC, 8);
+
+  h->nx = Nx;  h->ny = Ny;  h->nz = Nz;
+  h->brick   = brick;
+  h->nlines  = nlines;
+  h->maxstep = maxstep;
+  h->nbundle = nbundle;
+  h->nmask   = nmask;
+  h->integrator = RK4_variant();
+  h->chaos   = chaos_method;
+
+  h->tolerance = tolerance;
+  h->chaos_cut = chaos_cut;
+  h->tangent_cut = tangent_cut;
+  h->close_lo  = close_lo;
+  h->close_hi  = close_hi;
+  h->maxlen    = maxlen;
+  h->xeno      = xeno;
+  h->d_test    = d_test;
+  h->rng_seed  = rng_seed;
+
+  return;
+}
+
+
+static void fingerprint(int b, Brick *br)
+{
+  int i, j, k, i0, j0, k0, ni, nj, nk, o, n, count[8];
+  double sum[8][4];
+  unsigned char *c;
+  unsigned long hash;
+
+  i0 = brick * (b % nbx);
+  j0 = brick * ((b / nbx) % nby);
+  k0 = brick * (b / (nbx*nby));
+  ni = MIN(brick, Nx - i0);
+  nj = MIN(brick, Ny - j0);
+  nk = MIN(brick, Nz - k0);
+
+  memset(sum, 0, sizeof(sum));
+  memset(count, 0, sizeof(count));
+  hash = 14695981039346656037UL;
+
+  for (k=k0; k<k0+nk; k++) {
+    for (j=j0; j<j0+nj; j++) {
+      for (i=i0; i<i0+ni; i++) {
+        c = (unsigned char*) &B[k][j][i];
+        for (n=0; n<(int) sizeof(Real3Vect); n++) {
+          hash ^= c[n];
+          hash *= 1099511628211UL;
+        }
+
+        o = (2*(k-k0) >= nk ? 4 : 0) + (2*(j-j0) >= nj ? 2 : 0)
+          + (2*(i-i0) >= ni ? 1 : 0);
+        sum[o][0] += B[k][j][i].x1;
+        sum[o][1] += B[k][j][i].x2;
+        sum[o][2] += B[k][j][i].x3;
+        sum[o][3] += (SQR(B[k][j][i].x1) + SQR(B[k][j][i].x2) +
+                      SQR(B[k][j][i].x3));
+        count[o]++;
+      }
+    }
+  }
+
+  br->hash = hash;
+  for (o=0; o<8; o++)
+    for (n=0; n<4; n++)
+      br->oct[o][n] = (count[o] > 0) ? sum[o][n] / count[o] : 0.0;
+
+  return;
+}
+
+
+void cache_init(int size, double max_diff)
+{
+  int b;
+
+  if (size < 1)
+    ath_error("[cache_init]: cache_brick must be at least 1, not %d\n", size);
+
+  cache_free();
+  brick = size;
+  tol = max_diff;
+
+  nbx = (Nx + brick - 1) / brick;
+  nby = (Ny + brick - 1) / brick;
+  nbz = (Nz + brick - 1) / brick;
+  nbrick = nbx * nby * nbz;
+  nmask = (nbrick + 7) / 8;
+
+  bricks = (Brick*) calloc_1d_array(nbrick, sizeof(Brick));
+#pragma omp parallel for schedule(dynamic)
+  for (b=0; b<nbrick; b++)
+    fingerprint(b, &bricks[b]);
+
+  visited = (unsigned char**) calloc_2d_array(nlines, nmask, sizeof(unsigned char));
+  stops = (int*) calloc_1d_array(2*nlines, sizeof(int));
+  nreused = 0;
+
+  return;
+}
+
+
+void cache_free(void)
+{
+  if (bricks != NULL)      free_1d_array((void*) bricks);
+  if (visited != NULL)     free_2d_array((void**) visited);
+  if (stops != NULL)       free_1d_array((void*) stops);
+  if (same != NULL)        free_1d_array((void*) same);
+  if (old_seed != NULL)    free_1d_array((void*) old_seed);
+  if (old_pts != NULL)     free_1d_array((void*) old_pts);
+  if (old_visited != NULL) free_2d_array((void**) old_visited);
+  if (old_stops != NULL)   free_1d_array((void*) old_stops);
+  if (old_first != NULL)   free_1d_array((void*) old_first);
+  if (old_npts != NULL)    free_1d_array((void*) old_npts);
+  if (old_off != NULL)     free_1d_array((void*) old_off);
+
+  bricks = NULL;  visited = NULL;  stops = NULL;  same = NULL;
+  old_seed = old_pts = NULL;  old_visited = NULL;
+  old_stops = old_first = old_npts = NULL;  old_off = NULL;
+  brick = 0;
+  loaded = 0;
+
+  return;
+}
+
+
+int cache_load(char *fname)
+{
+  FILE *fp;
+  CacheHead h, mine;
+  Brick *old;
+  int b, n, o, c, ok;
+  long off;
+
+  if ((fp = fopen(fname, "rb")) == NULL) {
+    printf("cache: no %s; tracing every line\n", fname);
+    return 0;
+  }
+
+  /* everything but the point count has to match */
+  cache_head(&mine);
+  ok = (fread(&h, sizeof(h), 1, fp) == 1);
+  mine.npts = h.npts;
+  if (!ok || memcmp(&h, &mine, sizeof(h)) != 0) {
+    printf("cache: %s is for another grid or other parameters; "
+           "tracing every line\n", fname);
+    fclose(fp);
+    return 0;
+  }
+
+  /* which bricks are the same as last time */
+  old = (Brick*) calloc_1d_array(nbrick, sizeof(Brick));
+  if (fread(old, sizeof(Brick), nbrick, fp) != (size_t) nbrick)
+    ath_error("[cache_load]: Error reading %s\n", fname);
+
+  same = (char*) calloc_1d_array(nbrick, sizeof(char));
+  for (b=0; b<nbrick; b++) {
+    ok = (old[b].hash == bricks[b].hash);
+    if (!ok && tol > 0.0) {
+      for (o=0, ok=1; o<8; o++)
+        for (c=0; c<4; c++)
+          if (fabs(old[b].oct[o][c] - bricks[b].oct[o][c]) > tol)
+            ok = 0;
+    }
+    same[b] = ok;
+  }
+  free_1d_array((void*) old);
+
+  /* and the lines */
+  old_seed    = (Real3Vect*) calloc_1d_array(nlines, sizeof(Real3Vect));
+  old_visited = (unsigned char**) calloc_2d_array(nlines, nmask, sizeof(unsigned char));
+  old_stops   = (int*) calloc_1d_array(2*nlines, sizeof(int));
+  old_first   = (int*) calloc_1d_array(nlines, sizeof(int));
+  old_npts    = (int*) calloc_1d_array(nlines, sizeof(int));
+  old_off     = (long*) calloc_1d_array(nlines, sizeof(long));
+  old_pts     = (Real3Vect*) calloc_1d_array(MAX(h.npts, 1), sizeof(Real3Vect));
+
+  for (n=0, off=0; n<nlines; n++) {
+    if (fread(&old_seed[n], sizeof(Real3Vect), 1, fp) != 1 ||
+        fread(&old_stops[2*n], sizeof(int), 2, fp) != 2 ||
+        fread(&old_first[n], sizeof(int), 1, fp) != 1 ||
+        fread(&old_npts[n], sizeof(int), 1, fp) != 1 ||
+        fread(old_visited[n], 1, nmask, fp) != (size_t) nmask ||
+        off + old_npts[n] > h.npts ||
+        fread(&old_pts[off], sizeof(Real3Vect), old_npts[n], fp)
+        != (size_t) old_npts[n])
+      ath_error("[cache_load]: Error reading %s\n", fname);
+
+    old_off[n] = off;
+    off += old_npts[n];
+  }
+  fclose(fp);
+
+  loaded = 1;
+
+  return 1;
+}
+
+
+int cache_reuse(int line, Real3Vect *xvals, int *stop)
+{
+  int b, j;
+
+  if (!loaded)
+    return 0;
+
+  if (memcmp(&old_seed[line], &xvals[maxstep/2], sizeof(Real3Vect)) != 0)
+    return 0;
+
+  for (b=0; b<nbrick; b++)
+    if ((old_visited[line][b/8] & (1 << (b%8))) && !same[b])
+      return 0;
+
+  for (j=0; j<old_npts[line]; j++)
+    xvals[old_first[line] + j] = old_pts[old_off[line] + j];
+  stop[0] = old_stops[2*line];
+  stop[1] = old_stops[2*line+1];
+
+  memcpy(visited[line], old_visited[line], nmask);
+  cache_line(line, stop);
+
+#pragma omp atomic
+  nreused++;
+
+  return 1;
+}
+
+
+/* mark the bricks which overlap [lo, hi] */
+static void mark_box(unsigned char *mask, double *lo, double *hi)
+{
+  int a, blo[3], bhi[3], nb[3], i, j, k, b;
+
+  nb[0] = nbx;  nb[1] = nby;  nb[2] = nbz;
+  for (a=0; a<3; a++) {
+    blo[a] = (int) floor(MAX(lo[a], 0.0) / brick);
+    bhi[a] = (int) floor(MAX(hi[a], 0.0) / brick);
+    blo[a] = MIN(blo[a], nb[a]-1);
+    bhi[a] = MIN(bhi[a], nb[a]-1);
+  }
+
+  for (k=blo[2]; k<=bhi[2]; k++) {
+    for (j=blo[1]; j<=bhi[1]; j++) {
+      for (i=blo[0]; i<=bhi[0]; i++) {
+        b = (k*nby + j)*nbx + i;
+        mask[b/8] |= (1 << (b%8));
+      }
+    }
+  }
+
+  return;
+}
+
+
+/* each step reads B within a cell of where it goes, and the trial
+   steps it rejected went up to a few times further (the step size
+   can grow by at most 4 from one step to the next) */
+void cache_visit(int line, Real3Vect *xvals)
+{
+  int j;
+  double pad, lo[3], hi[3];
+  Real3Vect *p, *q;
+
+  if (brick == 0)
+    return;
+
+  for (j=0; j<maxstep; j++) {
+    p = &xvals[j];
+    if (!(p->x1 > 0.0 && p->x2 > 0.0 && p->x3 > 0.0))
+      continue;
+
+    q = p;
+    if (j+1 < maxstep &&
+        xvals[j+1].x1 > 0.0 && xvals[j+1].x2 > 0.0 && xvals[j+1].x3 > 0.0)
+      q = &xvals[j+1];
+
+    pad = 1.0 + 4.0*dist(p, q);
+    lo[0] = MIN(p->x1, q->x1) - pad;  hi[0] = MAX(p->x1, q->x1) + pad;
+    lo[1] = MIN(p->x2, q->x2) - pad;  hi[1] = MAX(p->x2, q->x2) + pad;
+    lo[2] = MIN(p->x3, q->x3) - pad;  hi[2] = MAX(p->x3, q->x3) + pad;
+
+    mark_box(visited[line], lo, hi);
+  }
+
+  return;
+}
+
+
+void cache_line(int line, int *stop)
+{
+  if (brick == 0)
+    return;
+
+  stops[2*line]   = stop[0];
+  stops[2*line+1] = stop[1];
+
+  return;
+}
+
+
+void cache_save(char *fname, Real3Vect **xvals, Real3Vect *seedpoints)
+{
+  FILE *fp;
+  CacheHead h;
+  int n, first, last, npts;
+
+  printf("cache: reused %d of %d lines\n", nreused, nlines);
+
+  cache_head(&h);
+  for (n=0; n<nlines; n++) {
+    for (first=0; first<maxstep && xvals[n][first].x1 == -1.0; first++) ;
+    for (last=maxstep-1; last>first && xvals[n][last].x1 == -1.0; last--) ;
+    if (first < maxstep)
+      h.npts += last - first + 1;
+  }
+
+  if ((fp = fopen(fname, "wb")) == NULL)
+    ath_error("[cache_save]: could not open %s\n", fname);
+
+  if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+      fwrite(bricks, sizeof(Brick), nbrick, fp) != (size_t) nbrick)
+    ath_error("[cache_save]: Error writing %s\n", fname);
+
+  for (n=0; n<nlines; n++) {
+    for (first=0; first<maxstep && xvals[n][first].x1 == -1.0; first++) ;
+    for (last=maxstep-1; last>first && xvals[n][last].x1 == -1.0; last--) ;
+    npts = (first < maxstep) ? last - first + 1 : 0;
+    first = MIN(first, maxstep-1);
+
+    if (fwrite(&seedpoints[n], sizeof(Real3Vect), 1, fp) != 1 ||
+        fwrite(&stops[2*n], sizeof(int), 2, fp) != 2 ||
+        fwrite(&first, sizeof(int), 1, fp) != 1 ||
+        fwrite(&npts, sizeof(int), 1, fp) != 1 ||
+        fwrite(visited[n], 1, nmask, fp) != (size_t) nmask ||
+        fwrite(&xvals[n][first], sizeof(Real3Vect), npts, fp) != (size_t) npts)
+      ath_error("[cache_save]: Error writing %s\n", fname);
+  }
+  fclose(fp);
+
+  return;
+}
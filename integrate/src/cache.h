@@ -0,0 +1,60 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+
+/* reuse lines from the previous snapshot of a movie where the field
+   they ran through hasn't changed.
+
+   the grid is cut into bricks of `brick' cells on a side.  each brick
+   gets a hash of the normalized field in it, and a coarse fingerprint
+   (the mean of B and of |B|^2 in each of its eight octants).  while a
+   line is traced, every brick it (or a member of its bundle) could
+   have looked at is marked: the bricks around each step, with a
+   margin for the stencil and for trial steps which were rejected.
+
+   the cache file holds the bricks, and for every line its seed, the
+   bricks it visited, why it stopped and its points.  when the next
+   snapshot is run with that file as its cache_in, line n is copied
+   instead of traced if it has the same seed, the integration
+   parameters are the same, and every brick it visited either hashes
+   the same or has a fingerprint within `tol' of the old one.  since
+   normalizing divides by the rms field, a change anywhere in the box
+   changes every hash a little; tol > 0 is what lets the rest of the
+   box through.
+
+   lines must not depend on each other, so this is only for plain
+   runs: no evenly spaced seeding, sweeps, several fields, or MPI. */
+
+/* fingerprint B (after normalize_B()) and get ready to record the
+   bricks visited by nlines lines */
+void cache_init(int brick, double tol);
+void cache_free(void);
+
+/* read the cache of the previous snapshot.  a missing or mismatched
+   file just means nothing is reused; returns 1 if it can be used. */
+int cache_load(char *fname);
+
+/* if line n can be reused, fill in xvals (whose seed is already in
+   xvals[maxstep/2]) and stop from the cache, and return 1 */
+int cache_reuse(int line, Real3Vect *xvals, int *stop);
+
+/* for integrate_line(): mark the bricks around xvals as visited by
+   line n.  does nothing unless cache_init() was called. */
+void cache_visit(int line, Real3Vect *xvals);
+
+/* line n was traced and stopped for stop[0], stop[1] */
+void cache_line(int line, int *stop);
+
+/* write the cache for the next snapshot, and say how much of this
+   one was reused.  line n started from seedpoints[n]. */
+void cache_save(char *fname, Real3Vect **xvals, Real3Vect *seedpoints);
+
+#endif
@@ -0,0 +1,612 @@
+#include "domain.h"
+
+#ifdef MPI_PARALLEL
+
+static int myid, nproc;
+static int *kstart = NULL;      /* rank r owns kstart[r] <= k < kstart[r+1] */
+static Real3Vect ***slab = NULL; /* planes Klo..Khi-1 of B */
+
+/* a line, in one direction, on its way through the domain */
+typedef struct Packet_s{
+  RK4State s;
+  int line;                     /* which line */
+  int member;                   /* bundle member, or -1 for the main line */
+}Packet;
+
+static MPI_Datatype packet_type;
+
+/* lines which have left this rank's slab, and wait for the next swap */
+static Packet *outbox = NULL;
+static int nout = 0, outcap = 0;
+
+/* pieces of main lines traced on this rank, to send to rank 0.  each
+   is: line, dir, first, npts, why (-1 if it carries on elsewhere),
+   then the points xvals[first] ... xvals[first+npts-1]. */
+static double *pieces = NULL;
+static int npieces = 0, piececap = 0;
+
+/* for the chaos cut: at each point of each main line, the sum over
+   the bundle of the squared distance to the main line, and the number
+   of bundle members which got that far. */
+static Real3Vect **mainline;
+static double **sig2;
+static int **nsig;
+
+
+/* the rank whose slab x is in.  points outside the box go to the
+   nearest slab. */
+static int owner(Real3Vect *x)
+{
+  int k, r;
+
+  k = (int) floor(MAX(MIN(x->x3, (double) Nz), -1.0));
+  k = MAX(k, 0);
+  k = MIN(k, Nz-1);
+
+  for (r=0; r<nproc-1 && k >= kstart[r+1]; r++)
+    ;
+
+  return r;
+}
+
+static int inside(Real3Vect *x)
+{
+  return owner(x) == myid;
+}
+
+
+/* athena writes tile n of id0/<base>.<num>.vtk to
+   id<n>/<base>-id<n>.<num>.vtk (see join-vtk.rb) */
+static void tile_name(char *vtkfile, int n, char *name)
+{
+  char *id0, *sfx;
+
+  if (n == 0) {
+    strcpy(name, vtkfile);
+    return;
+  }
+
+  id0 = strstr(vtkfile, "id0/");
+  if (id0 == NULL)
+    ath_error("[tile_name]: %s is not in an id0/ directory\n", vtkfile);
+
+  /* the suffix is the last two fields, .<num>.vtk */
+  for (sfx = strrchr(vtkfile, '.') - 1; sfx > id0+4 && *sfx != '.'; sfx--)
+    ;
+
+  sprintf(name, "%.*sid%d/%.*s-id%d%s",
+          (int) (id0 - vtkfile), vtkfile, n,
+          (int) (sfx - (id0+4)), id0+4, n, sfx);
+
+  return;
+}
+
+
+void domain_load(char *vtkfile, int ntile, int ghost)
+{
+  FILE *fp;
+  int t, r, k, (*n)[3], (*off)[3];
+  double (*origin)[3], spacing[3], lo[3], hi[3];
+  char name[512];
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+  MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+  ntile  = MAX(ntile, 1);
+  n      = (int (*)[3])    calloc_1d_array(ntile, sizeof(*n));
+  off    = (int (*)[3])    calloc_1d_array(ntile, sizeof(*off));
+  origin = (double (*)[3]) calloc_1d_array(ntile, sizeof(*origin));
+
+  /* the grid is whatever the tiles cover */
+  for (t=0; t<ntile; t++) {
+    tile_name(vtkfile, t, name);
+    if ((fp = fopen(name, "r")) == NULL)
+      ath_error("[domain_load]: could not open %s\n", name);
+    vtk_header(fp, n[t], origin[t], spacing);
+    fclose(fp);
+
+    for (k=0; k<3; k++) {
+      lo[k] = (t == 0) ? origin[t][k] : MIN(lo[k], origin[t][k]);
+      hi[k] = (t == 0) ? origin[t][k] + n[t][k]*spacing[k]
+                       : MAX(hi[k], origin[t][k] + n[t][k]*spacing[k]);
+    }
+  }
+
+  ox = lo[0];  oy = lo[1];  oz = lo[2];
+  dx = spacing[0];  dy = spacing[1];  dz = spacing[2];
+  Nx = (int) floor((hi[0] - lo[0])/dx + 0.5);
+  Ny = (int) floor((hi[1] - lo[1])/dy + 0.5);
+  Nz = (int) floor((hi[2] - lo[2])/dz + 0.5);
+  vtk_whole();
+
+  for (t=0; t<ntile; t++)
+    for (k=0; k<3; k++)
+      off[t][k] = (int) floor((origin[t][k] - lo[k])/spacing[k] + 0.5);
+
+  /* cut the grid into slabs */
+  if (Nz < nproc)
+    ath_error("[domain_load]: %d planes won't go round %d ranks\n", Nz, nproc);
+
+  kstart = (int*) calloc_1d_array(nproc+1, sizeof(int));
+  for (r=0; r<=nproc; r++)
+    kstart[r] = (int) (((double) r * Nz) / nproc);
+
+  Klo = MAX(kstart[myid] - ghost, 0);
+  Khi = MIN(kstart[myid+1] + ghost + 1, Nz);
+
+  /* B keeps its usual shape, but only the planes in memory are set */
+  B = (Real3Vect***) calloc_1d_array(Nz, sizeof(Real3Vect**));
+  slab = (Real3Vect***) calloc_3d_array_numa(Khi-Klo, Ny, Nx, sizeof(Real3Vect));
+  for (k=Klo; k<Khi; k++)
+    B[k] = slab[k-Klo];
+
+  for (t=0; t<ntile; t++) {
+    if (off[t][2] >= Khi || off[t][2] + n[t][2] <= Klo)
+      continue;
+
+    tile_name(vtkfile, t, name);
+    if ((fp = fopen(name, "r")) == NULL)
+      ath_error("[domain_load]: could not open %s\n", name);
+    vtkread_part(fp, off[t][0], off[t][1], off[t][2]);
+    fclose(fp);
+  }
+
+  printf("[domain_load]: rank %d holds planes %d to %d of %d\n",
+         myid, Klo, Khi-1, Nz);
+
+  free_1d_array((void*) n);
+  free_1d_array((void*) off);
+  free_1d_array((void*) origin);
+
+  return;
+}
+
+
+void domain_free(void)
+{
+  if (slab != NULL) {
+    free_3d_array((void***) slab);
+    free_1d_array((void*) B);
+  }
+  if (kstart != NULL)
+    free_1d_array((void*) kstart);
+
+  slab = NULL;
+  B = NULL;
+  kstart = NULL;
+
+  return;
+}
+
+
+void domain_normalize_B(void)
+{
+  double B2, Brms;
+  int i, j, k;
+
+  /* only count the planes this rank owns */
+  B2 = 0.0;
+  for(k=kstart[myid]; k<kstart[myid+1]; k++){
+    for(j=0; j<Ny; j++){
+      for(i=0; i<Nx; i++){
+        B2 += (SQR(B[k][j][i].x1) +
+               SQR(B[k][j][i].x2) +
+               SQR(B[k][j][i].x3));
+      }
+    }
+  }
+
+  MPI_Allreduce(&B2, &Brms, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  Brms = sqrt(Brms / ((double) Nx*Ny*Nz));
+
+  for(k=Klo; k<Khi; k++){
+    for(j=0; j<Ny; j++){
+      for(i=0; i<Nx; i++){
+        B[k][j][i].x1 /= Brms;
+        B[k][j][i].x2 /= Brms;
+        B[k][j][i].x3 /= Brms;
+      }
+    }
+  }
+
+  return;
+}
+
+
+static void send_later(Packet *p)
+{
+#pragma omp critical (domain_outbox)
+  {
+    if (nout == outcap) {
+      outcap = MAX(2*outcap, 64);
+      outbox = (Packet*) realloc(outbox, outcap*sizeof(Packet));
+      if (outbox == NULL)
+        ath_error("[send_later]: out of memory\n");
+    }
+    outbox[nout++] = *p;
+  }
+
+  return;
+}
+
+
+/* points lo..hi of a main line, and why it stopped if it did */
+static void add_piece(Packet *p, Real3Vect *xvals, int lo, int hi, int done)
+{
+  int j, m, npts = MAX(hi - lo + 1, 0);
+
+  if (npts == 0 && !done)
+    return;
+
+#pragma omp critical (domain_pieces)
+  {
+    if (npieces + 5 + 3*npts > piececap) {
+      piececap = MAX(2*piececap, npieces + 5 + 3*npts);
+      pieces = (double*) realloc(pieces, piececap*sizeof(double));
+      if (pieces == NULL)
+        ath_error("[add_piece]: out of memory\n");
+    }
+
+    m = npieces;
+    pieces[m++] = p->line;
+    pieces[m++] = p->s.dir;
+    pieces[m++] = lo;
+    pieces[m++] = npts;
+    pieces[m++] = done ? p->s.why : -1;
+    for (j=lo; j<lo+npts; j++) {
+      pieces[m++] = xvals[j].x1;
+      pieces[m++] = xvals[j].x2;
+      pieces[m++] = xvals[j].x3;
+    }
+    npieces = m;
+  }
+
+  return;
+}
+
+
+/* points lo..hi of a bundle member, added into the chaos cut sums */
+static void add_sigma(Packet *p, Real3Vect *xvals, int lo, int hi)
+{
+  int j;
+  double d;
+
+  for (j=lo; j<=hi; j++) {
+    d = SQR(dist(&mainline[p->line][j], &xvals[j]));
+
+#pragma omp atomic
+    sig2[p->line][j] += d;
+#pragma omp atomic
+    nsig[p->line][j] += 1;
+  }
+
+  return;
+}
+
+
+/* advance p as far as it goes on this rank, and file away the points
+   it made.  a fresh line also owns its seed point. */
+static void run_packet(Packet *p, Real3Vect *xvals, int fresh)
+{
+  int i0, lo, hi, moved;
+
+  i0 = p->s.i;
+  moved = RK4_advance(&p->s, xvals, d_test, inside);
+
+  if (p->s.dir > 0) {
+    lo = fresh ? i0 : i0+1;
+    hi = p->s.last;
+  } else {
+    lo = p->s.last;
+    hi = i0-1;
+  }
+
+  if (p->member < 0)
+    add_piece(p, xvals, lo, hi, !moved);
+  else
+    add_sigma(p, xvals, lo, hi);
+
+  if (moved)
+    send_later(p);
+
+  return;
+}
+
+
+/* start a line at p->s.x: forward first, then backward from the
+   same seed, exactly as RK4_integrate() would.  the point after the
+   seed starts out as integrate_line() leaves it: -1 for main lines
+   and 0 for the bundle. */
+static void start_line(Packet *p, Real3Vect *xvals)
+{
+  double init = (p->member < 0) ? -1.0 : 0.0;
+
+  if (p->member < 0)
+    printf("integrating line %d...\n", p->line);
+
+  xvals[maxstep/2] = p->s.x;
+  xvals[maxstep/2+1].x1 = xvals[maxstep/2+1].x2 = xvals[maxstep/2+1].x3 = init;
+
+  RK4_start(&p->s, xvals, 1);
+  run_packet(p, xvals, 1);
+
+  RK4_start(&p->s, xvals, -1);
+  run_packet(p, xvals, 0);
+
+  return;
+}
+
+
+/* send everything in the outbox to its new owner.  returns the number
+   of lines which changed hands anywhere; when that is 0, every line
+   has stopped and the phase is over. */
+static int swap_lines(Packet **inbox, int *nin)
+{
+  int *scount, *sdisp, *rcount, *rdisp, *dest;
+  int r, m, total;
+  Packet *sendbuf;
+
+  MPI_Allreduce(&nout, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  *nin = 0;
+  if (total == 0)
+    return 0;
+
+  scount = (int*) calloc_1d_array(nproc, sizeof(int));
+  sdisp  = (int*) calloc_1d_array(nproc, sizeof(int));
+  rcount = (int*) calloc_1d_array(nproc, sizeof(int));
+  rdisp  = (int*) calloc_1d_array(nproc, sizeof(int));
+  dest   = (int*) calloc_1d_array(MAX(nout, 1), sizeof(int));
+  sendbuf = (Packet*) calloc_1d_array(MAX(nout, 1), sizeof(Packet));
+
+  /* sort the outbox by destination */
+  for (m=0; m<nout; m++) {
+    dest[m] = owner(&outbox[m].s.x);
+    scount[dest[m]]++;
+  }
+  for (r=1; r<nproc; r++)
+    sdisp[r] = sdisp[r-1] + scount[r-1];
+  for (m=0; m<nout; m++)
+    sendbuf[sdisp[dest[m]]++] = outbox[m];
+  for (r=0; r<nproc; r++)
+    sdisp[r] -= scount[r];
+
+  MPI_Alltoall(scount, 1, MPI_INT, rcount, 1, MPI_INT, MPI_COMM_WORLD);
+  for (r=0; r<nproc; r++) {
+    rdisp[r] = (r == 0) ? 0 : rdisp[r-1] + rcount[r-1];
+    *nin += rcount[r];
+  }
+
+  free(*inbox);
+  *inbox = (Packet*) calloc_1d_array(MAX(*nin, 1), sizeof(Packet));
+  MPI_Alltoallv(sendbuf, scount, sdisp, packet_type,
+                *inbox, rcount, rdisp, packet_type, MPI_COMM_WORLD);
+  nout = 0;
+
+  free_1d_array((void*) scount);
+  free_1d_array((void*) sdisp);
+  free_1d_array((void*) rcount);
+  free_1d_array((void*) rdisp);
+  free_1d_array((void*) dest);
+  free_1d_array((void*) sendbuf);
+
+  return total;
+}
+
+
+/* trace the lines in starts[] (the ones which start on this rank),
+   and whatever the other ranks pass over, until everything stops */
+static void run_rounds(Packet *starts, int nstart)
+{
+  Packet *inbox = NULL;
+  Real3Vect *xv;
+  int n, nin = 0, nwork, round;
+  double t0;
+
+  for (round=0; ; round++) {
+    t0 = trace_begin();
+    nwork = nstart + nin;
+
+#pragma omp parallel private(xv)
+    {
+      xv = (Real3Vect*) calloc_1d_array(maxstep, sizeof(Real3Vect));
+
+#pragma omp for schedule(dynamic)
+      for (n=0; n<nwork; n++) {
+        if (n < nstart)
+          start_line(&starts[n], xv);
+        else
+          run_packet(&inbox[n-nstart], xv, 0);
+      }
+
+      free_1d_array((void*) xv);
+    }
+
+    trace_end("round", t0, nwork);
+    nstart = 0;
+
+    if (swap_lines(&inbox, &nin) == 0)
+      break;
+  }
+
+  free(inbox);
+
+  return;
+}
+
+
+/* put the pieces of the main lines together on rank 0 */
+static void gather_lines(Real3Vect **xvals, int *stop)
+{
+  int *counts = NULL, *disps = NULL, r, m, j, line, dir, first, npts, why;
+  double *all = NULL;
+
+  if (myid == 0) {
+    counts = (int*) calloc_1d_array(nproc, sizeof(int));
+    disps  = (int*) calloc_1d_array(nproc, sizeof(int));
+  }
+
+  MPI_Gather(&npieces, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  if (myid == 0) {
+    for (r=1; r<nproc; r++)
+      disps[r] = disps[r-1] + counts[r-1];
+    all = (double*) calloc_1d_array(MAX(disps[nproc-1] + counts[nproc-1], 1),
+                                    sizeof(double));
+  }
+
+  MPI_Gatherv(pieces, npieces, MPI_DOUBLE,
+              all, counts, disps, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+  if (myid == 0) {
+    for (m=0; m < disps[nproc-1] + counts[nproc-1]; ) {
+      line  = (int) all[m++];
+      dir   = (int) all[m++];
+      first = (int) all[m++];
+      npts  = (int) all[m++];
+      why   = (int) all[m++];
+
+      for (j=first; j<first+npts; j++) {
+        xvals[line][j].x1 = all[m++];
+        xvals[line][j].x2 = all[m++];
+        xvals[line][j].x3 = all[m++];
+      }
+      if (why >= 0)
+        stop[2*line + (dir > 0 ? 0 : 1)] = why;
+    }
+
+    free_1d_array((void*) counts);
+    free_1d_array((void*) disps);
+    free_1d_array((void*) all);
+  }
+
+  free(pieces);
+  pieces = NULL;
+  npieces = piececap = 0;
+
+  return;
+}
+
+
+/* the end of integrate_line(): cut the main line off where the
+   bundle spreads out past chaos_cut.  bundle members which never got
+   to point j count as sitting at the origin, as they do there. */
+static void cut_line(Real3Vect *xvals, double *s2, int *ns, int *stop)
+{
+  int j;
+  double sigma;
+
+  /*   first, going forward... */
+  for (j=maxstep/2; j<maxstep; j++) {
+    sigma = s2[j] + (nbundle - ns[j]) *
+      (SQR(xvals[j].x1) + SQR(xvals[j].x2) + SQR(xvals[j].x3));
+    sigma = sqrt(sigma/nbundle);
+    if (sigma > chaos_cut)
+      break;
+  }
+  if (j<maxstep && xvals[j].x1 != -1.0) /* still going when cut off */
+    stop[0] = STOP_CHAOS;
+  while (j<maxstep) {
+    xvals[j].x1 = xvals[j].x2 = xvals[j].x3 = -1.0;
+    j++;
+  }
+
+    /*   ...then backward */
+  for (j=maxstep/2; j>0; j--) {
+    sigma = s2[j] + (nbundle - ns[j]) *
+      (SQR(xvals[j].x1) + SQR(xvals[j].x2) + SQR(xvals[j].x3));
+    sigma = sqrt(sigma/nbundle);
+    if (sigma > chaos_cut)
+      break;
+  }
+  if (j>0 && xvals[j].x1 != -1.0)
+    stop[1] = STOP_CHAOS;
+  while (j>0) {
+    xvals[j].x1 = xvals[j].x2 = xvals[j].x3 = -1.0;
+    j--;
+  }
+
+  return;
+}
+
+
+void domain_integrate(Real3Vect **xvals, Real3Vect *seedpoints)
+{
+  Packet *starts;
+  int i, n, nstart, *stop;
+  double *kick, t0;
+
+  MPI_Type_contiguous((int) sizeof(Packet), MPI_BYTE, &packet_type);
+  MPI_Type_commit(&packet_type);
+
+  stop = (int*) calloc_1d_array(2*nlines, sizeof(int));
+  starts = (Packet*) calloc_1d_array(nlines*MAX(nbundle, 1), sizeof(Packet));
+
+  /* the main lines... */
+  t0 = trace_begin();
+  for (n=0, nstart=0; n<nlines; n++) {
+    if (!inside(&seedpoints[n]))
+      continue;
+    starts[nstart].line = n;
+    starts[nstart].member = -1;
+    starts[nstart].s.x = seedpoints[n];
+    nstart++;
+  }
+  run_rounds(starts, nstart);
+
+  gather_lines(xvals, stop);
+  MPI_Bcast(xvals[0], 3*nlines*maxstep, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  trace_end("main lines", t0, -1);
+
+  /* ...then the bundles */
+  t0 = trace_begin();
+  mainline = xvals;
+  sig2 = (double**) calloc_2d_array(nlines, maxstep, sizeof(double));
+  nsig = (int**)    calloc_2d_array(nlines, maxstep, sizeof(int));
+  kick = (double*)  calloc_1d_array(4*nbundle, sizeof(double));
+
+  for (n=0, nstart=0; n<nlines; n++) {
+    random_normal_block(rng_seed, RNG_BUNDLE, n, nbundle, 0.0, KICK, kick);
+
+    for (i=0; i<nbundle; i++) {
+      starts[nstart].s.x = seedpoints[n];
+      starts[nstart].s.x.x1 += kick[4*i];
+      starts[nstart].s.x.x2 += kick[4*i+1];
+      starts[nstart].s.x.x3 += kick[4*i+2];
+
+      if (!inside(&starts[nstart].s.x))
+        continue;
+      starts[nstart].line = n;
+      starts[nstart].member = i;
+      nstart++;
+    }
+  }
+  run_rounds(starts, nstart);
+
+  MPI_Reduce(myid == 0 ? MPI_IN_PLACE : sig2[0], sig2[0], nlines*maxstep,
+             MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(myid == 0 ? MPI_IN_PLACE : nsig[0], nsig[0], nlines*maxstep,
+             MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  trace_end("bundles", t0, -1);
+
+  if (myid == 0) {
+    for (n=0; n<nlines; n++) {
+      cut_line(xvals[n], sig2[n], nsig[n], &stop[2*n]);
+      stats_line(n, &stop[2*n]);
+    }
+  }
+
+  free_1d_array((void*) kick);
+  free_2d_array((void**) sig2);
+  free_2d_array((void**) nsig);
+  free_1d_array((void*) starts);
+  free_1d_array((void*) stop);
+  free(outbox);
+  outbox = NULL;
+  outcap = 0;
+
+  MPI_Type_free(&packet_type);
+
+  return;
+}
+
+#endif /* MPI_PARALLEL */
@@ -0,0 +1,55 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#ifdef MPI_PARALLEL
+
+#include <mpi.h>
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+#include "random.h"
+#include "rk4.h"
+#include "stats.h"
+#include "trace.h"
+#include "numa.h"
+#include "lines.h"
+
+/* domain-decomposed integration, for fields too big for one node.
+
+   the grid is cut into slabs in z, one per rank.  each rank only
+   reads its own slab of B plus `ghost' planes on either side, so that
+   RK4 steps near the edge of the slab don't have to leave it.  (steps
+   which reach past the ghost planes see the nearest plane in memory,
+   so `ghost' should be a few times the longest step.)
+
+   every rank computes the same seeds, and starts the lines whose
+   seeds fall in its slab.  when a line leaves the slab its RK4State
+   is passed to the rank which owns the new position, and it carries
+   on from there.  this goes in rounds: each rank advances everything
+   it holds as far as it can, then the ranks swap the lines which
+   left.  the run is over when a round ends with nothing to swap.
+
+   the main lines go first and are collected on rank 0, which sends
+   them to everyone.  then the bundles are traced the same way, and
+   each point adds its distance from the main line into a running sum
+   for the chaos cut, so the bundles are never stored.  every rank
+   holds the main lines and one such sum per point. */
+
+/* read the field.  ntile = 0 means vtkfile is one joined file;
+   otherwise vtkfile is id0/<base>.<num>.vtk and the other tiles are
+   id<n>/<base>-id<n>.<num>.vtk for 0 < n < ntile, as in join-vtk.rb.
+   only cell_centered_B is read. */
+void domain_load(char *vtkfile, int ntile, int ghost);
+void domain_free(void);
+
+/* normalize_B(), but over the whole grid */
+void domain_normalize_B(void);
+
+/* integrate every line.  every rank needs xvals and seedpoints; the
+   finished lines and their stats end up on rank 0. */
+void domain_integrate(Real3Vect **xvals, Real3Vect *seedpoints);
+
+#endif /* MPI_PARALLEL */
+
+#endif
@@ -0,0 +1,951 @@
+#include "lines.h"
+#include "stats.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* required for integration.  see rk4.h for documentation */
+int maxstep;
+double maxlen, tolerance;
+double close_lo, close_hi, xeno;
+
+/* see lines.h */
+int nlines, nbundle;
+double chaos_cut, tangent_cut;
+int chaos_method = CHAOS_BUNDLE;
+
+char *seed_weight;
+double seed_power;
+unsigned long rng_seed;
+
+double d_sep, d_test;
+int lod = 1;
+
+double simplify;
+
+int nattr;
+char *attr_name[MAXATTR];
+
+/* where each attribute comes from: a scalar array, or NULL for |B| */
+static float ***attr_src[MAXATTR];
+
+/* one thread's scratch space (see lines.h) */
+typedef struct Scratch_s{
+  int steps;                    /* maxstep when it was allocated */
+  int nrow;                     /* bundle members there is room for */
+  Real3Vect **bundle;           /* nrow by steps, zero outside lo..hi */
+  int *lo, *hi;                 /* what the last line wrote of each row */
+  double *kick;                 /* 4*nrow */
+  Real3Vect *line;              /* a main line, for scratch_line() */
+  int nline_attr;
+  float **line_attr;            /* nline_attr by steps */
+  float *growth;                /* for RK4State.growth */
+  char pad[64];                 /* keep threads off each other's lines */
+}Scratch;
+
+static Scratch serial_scratch;
+static Scratch *scratch = &serial_scratch;
+static int nscratch = 1;
+
+
+/* write the field line data to a file such that gnuplot's "splot"
+   command can read it:
+
+   - each line contains x, y, and z coordinates for a single point,
+     separated by spaces.
+
+   - different field lines are separated by blank lines.
+
+   - for economy, I don't output points closer than 1 cell (or, with
+     simplify > 0, points which lie close enough to a straight line
+     between their neighbours; see simplify_line()).
+
+   - output points in a unit system where x, y, and z go from -1 to 1.
+     this makes plotting easier later, but may not be what I want.
+
+   - any attributes follow in further columns, named in a comment on
+     the first line.
+*/
+/* print points keep[0..n-1] of a line, and the blank line after it */
+void print_line(FILE *outfile, Real3Vect *xvals, float **attr,
+                int *keep, int n)
+{
+  int j, a, m;
+
+  for (m=0; m<n; m++) {
+    j = keep[m];
+    fprintf(outfile, "%f\t%f\t%f",
+            (xvals[j].x1 + Ioff)/Nx_all - 0.5,
+            (xvals[j].x2 + Joff)/Ny_all - 0.5,
+            (xvals[j].x3 + Koff)/Nz_all - 0.5);
+    for (a=0; attr != NULL && a<nattr; a++)
+      fprintf(outfile, "\t%g", attr[a][j]);
+    fprintf(outfile, "\n");
+  }
+  fprintf(outfile, "\n");
+
+  return;
+}
+
+
+void write_data(char *outfname, Real3Vect **xvals, float ***attr)
+{
+  int i, a, **keep, *nkeep;
+  long nout;
+  FILE *outfile;
+
+  /* choose the points of every line first, in parallel... */
+  keep  = (int**) calloc_2d_array(nlines, maxstep, sizeof(int));
+  nkeep = (int*)  calloc_1d_array(nlines, sizeof(int));
+
+#pragma omp parallel for schedule(dynamic)
+  for (i=0; i<nlines; i++)
+    nkeep[i] = simplify_line(xvals[i], maxstep, keep[i]);
+
+  /* ...then write them out in order */
+  outfile = fopen(outfname, "w");
+  if (attr != NULL) {
+    fprintf(outfile, "# x y z");
+    for (a=0; a<nattr; a++)
+      fprintf(outfile, " %s", attr_name[a]);
+    fprintf(outfile, "\n");
+  }
+
+  for (i=0, nout=0; i<nlines; i++) {
+    print_line(outfile, xvals[i], (attr != NULL) ? attr[i] : NULL,
+               keep[i], nkeep[i]);
+    nout += nkeep[i];
+  }
+  fprintf(outfile, "\n");
+  fclose(outfile);
+
+  if (simplify > 0.0)
+    printf("simplify: wrote %ld points\n", nout);
+
+  free_2d_array((void**) keep);
+  free_1d_array((void*) nkeep);
+
+  return;
+}
+
+
+void write_line(FILE *outfile, Real3Vect *xvals, float **attr)
+{
+  int *keep, n;
+
+  keep = (int*) calloc_1d_array(maxstep, sizeof(int));
+  n = simplify_line(xvals, maxstep, keep);
+  print_line(outfile, xvals, attr, keep, n);
+  free_1d_array((void*) keep);
+
+  return;
+}
+
+
+/* distance from p to the segment from a to b */
+static double seg_dist(Real3Vect *p, Real3Vect *a, Real3Vect *b)
+{
+  double t, len2;
+  Real3Vect q;
+
+  len2 = SQR(b->x1 - a->x1) + SQR(b->x2 - a->x2) + SQR(b->x3 - a->x3);
+  t = 0.0;
+  if (len2 > 0.0) {
+    t = ((p->x1 - a->x1)*(b->x1 - a->x1) +
+         (p->x2 - a->x2)*(b->x2 - a->x2) +
+         (p->x3 - a->x3)*(b->x3 - a->x3)) / len2;
+    t = MIN(MAX(t, 0.0), 1.0);
+  }
+
+  q.x1 = a->x1 + t*(b->x1 - a->x1);
+  q.x2 = a->x2 + t*(b->x2 - a->x2);
+  q.x3 = a->x3 + t*(b->x3 - a->x3);
+
+  return dist(p, &q);
+}
+
+
+/* Douglas-Peucker on points lo..hi, which are all written: mark the
+   ones to keep in keep[].  the pending pieces go on a stack (in
+   stack[], which holds as many ints as the line has points) rather
+   than recursing, since a line can have tens of thousands of
+   points. */
+static void simplify_run(Real3Vect *xvals, int lo, int hi, char *keep,
+                         int *stack)
+{
+  int n, a, b, j, jmax;
+  double d, dmax;
+
+  keep[lo] = keep[hi] = 1;
+
+  n = 0;
+  stack[n++] = lo;
+  stack[n++] = hi;
+  while (n > 0) {
+    b = stack[--n];
+    a = stack[--n];
+
+    dmax = 0.0;
+    jmax = -1;
+    for (j=a+1; j<b; j++) {
+      d = seg_dist(&xvals[j], &xvals[a], &xvals[b]);
+      if (d > dmax) {
+        dmax = d;
+        jmax = j;
+      }
+    }
+
+    /* only pieces with points inside go on the stack.  their
+       insides don't overlap, so it never holds more than the line
+       has points. */
+    if (jmax >= 0 && dmax > simplify) {
+      keep[jmax] = 1;
+      if (jmax - a > 1) {
+        stack[n++] = a;     stack[n++] = jmax;
+      }
+      if (b - jmax > 1) {
+        stack[n++] = jmax;  stack[n++] = b;
+      }
+    }
+  }
+
+  return;
+}
+
+
+/* points outside the box (and the -1s where there is no line) are
+   never written */
+static int written(Real3Vect *x)
+{
+  return (x->x1 > 0.0 && x->x2 > 0.0 && x->x3 > 0.0);
+}
+
+
+int simplify_line(Real3Vect *xvals, int npts, int *keep)
+{
+  int j, lo, n;
+  char *mark;
+  Real3Vect last_output;
+
+  if (simplify <= 0.0) {
+    last_output.x1 = last_output.x2 = last_output.x3 = -10.0;
+
+    for (j=0, n=0; j<npts; j++) {
+      if (written(&xvals[j]) && dist(&xvals[j], &last_output) > 1.0) {
+        keep[n++] = j;
+        last_output = xvals[j];
+      }
+    }
+    return n;
+  }
+
+  /* simplify each run of points which would be written.  keep[] is
+     borrowed as the stack while it isn't needed for the answer. */
+  mark = (char*) calloc_1d_array(npts, sizeof(char));
+  for (j=0; j<npts; j++) {
+    if (!written(&xvals[j]))
+      continue;
+    for (lo=j; j+1<npts && written(&xvals[j+1]); j++) ;
+    simplify_run(xvals, lo, j, mark, keep);
+  }
+
+  for (j=0, n=0; j<npts; j++)
+    if (mark[j]) keep[n++] = j;
+  free_1d_array((void*) mark);
+
+  return n;
+}
+
+
+void attributes_init(char *names)
+{
+  char list[512];
+  int a;
+
+  attributes_free();
+  nattr = vtk_names(names, attr_name, MAXATTR, "attributes_init");
+
+  /* the scalars vtkread() has to find */
+  list[0] = '\0';
+  for (a=0; a<nattr; a++) {
+    if (strcmp(attr_name[a], "bmag") == 0 ||
+        strcmp(attr_name[a], "dye") == 0 ||
+        strcmp(attr_name[a], "specific_scalar[0]") == 0)
+      continue;
+
+    if (strlen(list) + strlen(attr_name[a]) + 2 > sizeof(list))
+      ath_error("[attributes_init]: list too long: %s\n", names);
+    if (list[0] != '\0')
+      strcat(list, ",");
+    strcat(list, attr_name[a]);
+  }
+  vtk_scalars(list);
+
+  return;
+}
+
+
+void attributes_bind(void)
+{
+  int a, n;
+
+  for (a=0; a<nattr; a++) {
+    attr_src[a] = NULL;
+
+    if (strcmp(attr_name[a], "bmag") == 0)
+      continue;
+
+    if (strcmp(attr_name[a], "dye") == 0 ||
+        strcmp(attr_name[a], "specific_scalar[0]") == 0) {
+      if (dye == NULL)
+        ath_error("[attributes_bind]: no specific_scalar[0] for %s\n",
+                  attr_name[a]);
+      attr_src[a] = dye;
+      continue;
+    }
+
+    for (n=0; n<nscalar; n++)
+      if (strcmp(attr_name[a], scalar_name[n]) == 0)
+        attr_src[a] = scalar[n];
+    if (attr_src[a] == NULL)
+      ath_error("[attributes_bind]: no SCALARS %s\n", attr_name[a]);
+  }
+
+  return;
+}
+
+
+void attributes_free(void)
+{
+  int a;
+
+  for (a=0; a<nattr; a++)
+    free(attr_name[a]);
+  nattr = 0;
+
+  return;
+}
+
+
+/* trilinear interpolation of a cell-centred scalar, with the same
+   clamping at the edges as interpolate_B() */
+static double interpolate_scalar(float ***s, Real3Vect *pos)
+{
+  int i, j, k;
+  double fx, fy, fz, c0, c1;
+
+  i = floor(pos->x1);
+  j = floor(pos->x2);
+  k = floor(pos->x3);
+
+  i = MIN(i, Nx-2);  i = MAX(i, 0);
+  j = MIN(j, Ny-2);  j = MAX(j, 0);
+  k = MIN(k, Khi-2); k = MAX(k, Klo);
+
+  fx = pos->x1 - i;
+  fy = pos->x2 - j;
+  fz = pos->x3 - k;
+
+  c0 = ((1.0-fy) * ((1.0-fx)*s[k  ][j  ][i] + fx*s[k  ][j  ][i+1]) +
+        fy       * ((1.0-fx)*s[k  ][j+1][i] + fx*s[k  ][j+1][i+1]));
+  c1 = ((1.0-fy) * ((1.0-fx)*s[k+1][j  ][i] + fx*s[k+1][j  ][i+1]) +
+        fy       * ((1.0-fx)*s[k+1][j+1][i] + fx*s[k+1][j+1][i+1]));
+
+  return (1.0-fz)*c0 + fz*c1;
+}
+
+
+void tag_name(char *fname, char *tag, char *name)
+{
+  char *ext;
+
+  ext = strrchr(fname, '.');
+  if (ext == NULL || strchr(ext, '/') != NULL)
+    sprintf(name, "%s.%s", fname, tag);
+  else
+    sprintf(name, "%.*s.%s%s", (int) (ext - fname), fname, tag, ext);
+
+  return;
+}
+
+
+void normalize_B(void)
+{
+  double B2, Brms;
+  int i, j, k, f;
+
+  /* B cut down to an roi is scaled by the rms over the whole box,
+     which the reader was given or added up (see ath_vtk.h) */
+  for (f=0; f<nfield; f++)
+    if (roi_cut && B == field[f]) break;
+
+  Brms = 0.0;
+  if (f < nfield) {
+    Brms = field_rms[f];
+  } else {
+    for(k=0; k<Nz; k++){
+      for(j=0; j<Ny; j++){
+        for(i=0; i<Nx; i++){
+          B2 = (SQR(B[k][j][i].x1) +
+                SQR(B[k][j][i].x2) +
+                SQR(B[k][j][i].x3));
+          Brms += B2;
+        }
+      }
+    }
+
+    Brms = sqrt(Brms / (Nx*Ny*Nz));
+  }
+
+  for(k=0; k<Nz; k++){
+    for(j=0; j<Ny; j++){
+      for(i=0; i<Nx; i++){
+        B[k][j][i].x1 /= Brms;
+        B[k][j][i].x2 /= Brms;
+        B[k][j][i].x3 /= Brms;
+      }
+    }
+  }
+
+  return;
+}
+
+
+/* set initial conditions for the field lines.  these can be
+   generated randomly or read in from a "seed file" written by
+   athena.  the format for the seed file is as follows:
+
+   # time = 17.960301
+   0    0.147636        0.127228        0.104124
+   1    0.020408        -0.260193       -0.021771
+   2    -0.140130       -0.028677       0.061697
+   3    -0.070474       -0.111080       -0.021247
+   4    0.113590        0.058400        0.154429
+   5    -0.055813       -0.248949       -0.052291
+
+   each row gives a point (labeled by an integer) and x, y, and z
+   coordinates (as %f, not %lf) in physical (not cell) coordinates.
+
+   random seeds are drawn from an alias table over the cells (see
+   alias.h), then placed uniformly within the chosen cell.  building
+   the table is a single pass over the grid; each draw is O(1).
+
+   a random seed which lands in a dead region around a null (see
+   nulls.h) is drawn again, from the next numbers in its stream, up
+   to MAXREDRAW times.  if every draw lands in one, the last is kept
+   (so line n still goes with seed n), and counted in the stats as
+   dead.  seeds from a file are left where they are.
+
+   with an roi (see ath_vtk.h), random seeds are only drawn inside it,
+   and seeds from a file which fall outside it are dropped, so that
+   the lines go to seeds which are.
+
+   returns how many seeds there are: nseed, or fewer if the file ran
+   out or seeds were dropped.
+*/
+#define MAXREDRAW 64
+
+static void weighted_seed_points(Real3Vect *seedpoints, int nseed,
+                                 int *nredraw, int *ndead)
+{
+  int i, j, k, n, c, t, ncell, field;
+  float *w;
+  double wt, u[4], v[4];
+  AliasTable table;
+
+  ncell = Nx*Ny*Nz;
+  w = (float*) calloc_1d_array(ncell, sizeof(float));
+  field = (strcmp(seed_weight, "field") == 0);
+
+#pragma omp parallel for private(i, j, n, wt)
+  for(k=0; k<Nz; k++){
+    for(j=0; j<Ny; j++){
+      n = (k*Ny + j)*Nx;
+      for(i=0; i<Nx; i++){
+        if (roi_cut && (i < roi_lo[0] || i+1 > roi_hi[0] ||
+                        j < roi_lo[1] || j+1 > roi_hi[1] ||
+                        k < roi_lo[2] || k+1 > roi_hi[2])) {
+          wt = 0.0;
+        } else if (field) {
+          wt = SQR(B[k][j][i].x1) + SQR(B[k][j][i].x2) + SQR(B[k][j][i].x3);
+          wt = pow(wt, 0.5*seed_power);
+        } else {
+          wt = MAX(dye[k][j][i], 0.0);
+        }
+        w[n+i] = wt;
+      }
+    }
+  }
+
+  alias_init(&table, w, ncell);
+
+  for (n=0; n<nseed; n++) {
+    for (t=0; t<MAXREDRAW; t++) {
+      random_uniform4(rng_seed, RNG_SEED, n, 2*t,   u);
+      random_uniform4(rng_seed, RNG_SEED, n, 2*t+1, v);
+
+      c = alias_draw(&table, u[0], u[1]);
+
+      i = c % Nx;
+      j = (c / Nx) % Ny;
+      k = c / (Nx*Ny);
+
+      seedpoints[n].x1 = i + v[0];
+      seedpoints[n].x2 = j + v[1];
+      seedpoints[n].x3 = k + v[2];
+      if (!null_dead(&seedpoints[n]))
+        break;
+    }
+    *nredraw += t;
+    if (t == MAXREDRAW) (*ndead)++;
+  }
+
+  alias_free(&table);
+
+  return;
+}
+
+int get_seed_points(char *seedfile, Real3Vect *seedpoints, int nseed)
+{
+  int i, t, ignore, nredraw = 0, ndead = 0, ndrop = 0;
+  FILE *fp;
+  char buf[512];
+  double u[4];
+  Real3Vect temp, x;
+
+  if (seedfile != NULL) {
+    fp = fopen(seedfile, "r");
+    if (fp == NULL)
+      ath_error("could not open seed file %s\n", seedfile);
+
+    i=0;
+    while(fgets(buf, sizeof(buf), fp) != NULL){
+      if (sscanf(buf, "%d %le %le %le",
+                 &ignore,
+                 &temp.x1, &temp.x2, &temp.x3) == 4){
+        if (i < nseed){
+          /* convert to cell units */
+          x.x1 = (temp.x1 - ox)/dx;
+          x.x2 = (temp.x2 - oy)/dy;
+          x.x3 = (temp.x3 - oz)/dz;
+
+          if (roi_cut && !in_bounds(&x))
+            ndrop++;
+          else
+            seedpoints[i++] = x;
+        }
+      }
+    }
+    fclose(fp);
+    nseed = i;
+  } else if (strcmp(seed_weight, "uniform") == 0) {
+    for (i=0; i<nseed; i++) {
+      for (t=0; t<MAXREDRAW; t++) {
+        random_uniform4(rng_seed, RNG_SEED, i, t, u);
+        if (roi_cut) {
+          seedpoints[i].x1 = roi_lo[0] + (roi_hi[0] - roi_lo[0]) * u[0];
+          seedpoints[i].x2 = roi_lo[1] + (roi_hi[1] - roi_lo[1]) * u[1];
+          seedpoints[i].x3 = roi_lo[2] + (roi_hi[2] - roi_lo[2]) * u[2];
+        } else {
+          seedpoints[i].x1 = Nx * u[0];
+          seedpoints[i].x2 = Ny * u[1];
+          seedpoints[i].x3 = Nz * u[2];
+        }
+        if (!null_dead(&seedpoints[i]))
+          break;
+      }
+      nredraw += t;
+      if (t == MAXREDRAW) ndead++;
+    }
+  } else if (strcmp(seed_weight, "field") == 0 ||
+             strcmp(seed_weight, "dye") == 0) {
+    if (strcmp(seed_weight, "dye") == 0 && dye == NULL)
+      ath_error("[get_seed_points]: no specific_scalar[0] to weight by\n");
+
+    weighted_seed_points(seedpoints, nseed, &nredraw, &ndead);
+  } else {
+    ath_error("[get_seed_points]: unknown seed_weight %s\n", seed_weight);
+  }
+
+  if (nredraw > 0)
+    printf("nulls: drew seeds again %d times to keep out of dead regions\n",
+           nredraw);
+  if (ndead > 0)
+    printf("nulls: %d seeds still in dead regions after %d draws; "
+           "their lines stop at once (lower null_bmax?)\n",
+           ndead, MAXREDRAW);
+  stats_seeds(nredraw, ndead);
+  if (ndrop > 0)
+    printf("roi: dropped %d seeds outside it\n", ndrop);
+
+  return nseed;
+}
+
+
+static void scratch_clear(Scratch *sc)
+{
+  if (sc->bundle != NULL) {
+    free_2d_array((void**) sc->bundle);
+    free_1d_array((void*) sc->lo);
+    free_1d_array((void*) sc->hi);
+    free_1d_array((void*) sc->kick);
+  }
+  if (sc->line != NULL)
+    free_1d_array((void*) sc->line);
+  if (sc->line_attr != NULL)
+    free_2d_array((void**) sc->line_attr);
+  if (sc->growth != NULL)
+    free_1d_array((void*) sc->growth);
+
+  memset(sc, 0, sizeof(Scratch));
+
+  return;
+}
+
+
+void scratch_init(void)
+{
+  scratch_free();
+
+#ifdef _OPENMP
+  nscratch = omp_get_max_threads();
+#else
+  nscratch = 1;
+#endif
+  scratch = (Scratch*) calloc_1d_array(nscratch, sizeof(Scratch));
+
+  return;
+}
+
+
+void scratch_free(void)
+{
+  int t;
+
+  for (t=0; t<nscratch; t++)
+    scratch_clear(&scratch[t]);
+  if (scratch != &serial_scratch)
+    free_1d_array((void*) scratch);
+
+  scratch = &serial_scratch;
+  nscratch = 1;
+
+  return;
+}
+
+
+/* this thread's scratch space, emptied if maxstep has changed */
+static Scratch *scratch_local(void)
+{
+  Scratch *sc;
+#ifdef _OPENMP
+  int t = omp_get_thread_num();
+  sc = &scratch[t < nscratch ? t : 0];
+#else
+  sc = &scratch[0];
+#endif
+
+  if (sc->steps != maxstep) {
+    scratch_clear(sc);
+    sc->steps = maxstep;
+  }
+
+  return sc;
+}
+
+
+/* room for a bundle of n, all zero */
+static void scratch_bundle(Scratch *sc, int n)
+{
+  if (n <= sc->nrow)
+    return;
+
+  if (sc->bundle != NULL) {
+    free_2d_array((void**) sc->bundle);
+    free_1d_array((void*) sc->lo);
+    free_1d_array((void*) sc->hi);
+    free_1d_array((void*) sc->kick);
+  }
+
+  sc->nrow = n;
+  sc->bundle = (Real3Vect**) calloc_2d_array(n, maxstep, sizeof(Real3Vect));
+  sc->lo   = (int*)    calloc_1d_array(n, sizeof(int));
+  sc->hi   = (int*)    calloc_1d_array(n, sizeof(int));
+  sc->kick = (double*) calloc_1d_array(4*n, sizeof(double));
+  stats_alloc(4, n*(maxstep*sizeof(Real3Vect) + 2*sizeof(int) + 4*sizeof(double)));
+
+  return;
+}
+
+
+Real3Vect *scratch_line(float ***attr)
+{
+  Scratch *sc = scratch_local();
+  int j;
+
+  if (sc->line == NULL) {
+    sc->line = (Real3Vect*) calloc_1d_array(maxstep, sizeof(Real3Vect));
+    stats_alloc(1, maxstep*sizeof(Real3Vect));
+  }
+  if (nattr > sc->nline_attr) {
+    if (sc->line_attr != NULL)
+      free_2d_array((void**) sc->line_attr);
+    sc->nline_attr = nattr;
+    sc->line_attr = (float**) calloc_2d_array(nattr, maxstep, sizeof(float));
+    stats_alloc(1, nattr*maxstep*sizeof(float));
+  }
+
+  for (j=0; j<maxstep; j++)
+    sc->line[j].x1 = sc->line[j].x2 = sc->line[j].x3 = -1.0;
+
+  *attr = (nattr > 0) ? sc->line_attr : NULL;
+
+  return sc->line;
+}
+
+
+/* trace bundle member x both ways, as RK4_integrate() does, and note
+   which part of it was written */
+static void trace_member(Real3Vect *x, int *lo, int *hi)
+{
+  RK4State s;
+  double t0;
+
+  t0 = trace_begin();
+  RK4_start(&s, x, 1);
+  RK4_advance(&s, x, 0.0, NULL);
+  *hi = s.last;
+  trace_end("forward", t0, s.i - maxstep/2);
+
+  t0 = trace_begin();
+  RK4_start(&s, x, -1);
+  RK4_advance(&s, x, 0.0, NULL);
+  *lo = s.last;
+  trace_end("backward", t0, maxstep/2 - s.i);
+
+  return;
+}
+
+
+/* the spread around point j of the main line: the rms distance of
+   the bundle from it, or, with growth, what the variational
+   equations say a bundle kicked by KICK would have.  past the end of
+   the line, it is as good as infinite. */
+static double spread(Real3Vect *xvals, Real3Vect **bundle, float *growth,
+                     int j)
+{
+  double sigma = 0.0;
+  int i;
+
+  if (growth != NULL)
+    return (xvals[j].x1 != -1.0) ? KICK*growth[j] : HUGE_VAL;
+
+  for (i=0; i<nbundle; i++) {
+    sigma += SQR(dist(&xvals[j], &bundle[i][j]));
+  }
+  return sqrt(sigma/nbundle);
+}
+
+
+/* the first point from the seed in direction dir where the spread
+   passes chaos_cut (tangent_cut for the variational one), or the end
+   of xvals (maxstep or 0) */
+static int chaos_point(Real3Vect *xvals, Real3Vect **bundle, float *growth,
+                       int dir)
+{
+  int j, end = (dir > 0) ? maxstep : 0;
+  double cut = (growth != NULL) ? tangent_cut : chaos_cut;
+
+  for (j=maxstep/2; j != end; j += dir)
+    if (spread(xvals, bundle, growth, j) > cut)
+      break;
+
+  return j;
+}
+
+
+/* how close bundle member row b (written from lo to hi) comes to x,
+   near b[*k].  *k walks along the row for as long as that brings it
+   closer, so a member which has fallen behind or run ahead of the
+   main line by a few steps is measured across the line, not along
+   it. */
+static double member_gap(Real3Vect *x, Real3Vect *b, int lo, int hi, int *k)
+{
+  double d;
+
+  while (*k+1 <= hi && dist(x, &b[*k+1]) < dist(x, &b[*k]))
+    (*k)++;
+  while (*k-1 >= lo && dist(x, &b[*k-1]) < dist(x, &b[*k]))
+    (*k)--;
+
+  d = dist(x, &b[*k]);
+  if (*k+1 <= hi)
+    d = MIN(d, seg_dist(x, &b[*k], &b[*k+1]));
+  if (*k-1 >= lo)
+    d = MIN(d, seg_dist(x, &b[*k-1], &b[*k]));
+
+  return d;
+}
+
+
+/* CHAOS_COMPARE: count how the two cuts in direction dir differ, and
+   how far the tangent spread is from the bundle's up to the first of
+   them: from the spread the cut uses, point by point, and from the
+   rms of how close each member comes to the main line.  the bundle
+   members take steps of their own size, so after a while point j of
+   a member is not level with point j of the main line, and the first
+   includes that drift along the line, which the second leaves out.
+   the tangent spread where the bundle cut is what tangent_cut would
+   have to be to cut there too.  this is a check, so the cursors are
+   allocated every time. */
+static void chaos_compare(Real3Vect *xvals, Scratch *sc, float *growth,
+                          int dir)
+{
+  int i, jb, jt, j, end, cut_b, cut_t, n = 0, *k;
+  double sb, sg, st, st_cut, lsum[4];
+
+  end = (dir > 0) ? maxstep : 0;
+  jb = chaos_point(xvals, sc->bundle, NULL,   dir);
+  jt = chaos_point(xvals, sc->bundle, growth, dir);
+  cut_b = (jb != end && xvals[jb].x1 != -1.0) ? abs(jb - maxstep/2) : -1;
+  cut_t = (jt != end && xvals[jt].x1 != -1.0) ? abs(jt - maxstep/2) : -1;
+  st_cut = (cut_b >= 0) ? lod*spread(xvals, sc->bundle, growth, jb) : 0.0;
+
+  k = (int*) calloc_1d_array(nbundle, sizeof(int));
+  for (i=0; i<nbundle; i++)
+    k[i] = maxstep/2;
+  memset(lsum, 0, sizeof(lsum));
+
+  for (j=maxstep/2; j != jb && j != jt; j += dir) {
+    sb = spread(xvals, sc->bundle, NULL,   j);
+    st = spread(xvals, sc->bundle, growth, j);
+    for (i=0, sg=0.0; i<nbundle; i++)
+      sg += SQR(member_gap(&xvals[j], sc->bundle[i], sc->lo[i], sc->hi[i],
+                           &k[i]));
+    sg = sqrt(sg/nbundle);
+
+    if (sb > 0.0 && sg > 0.0 && st > 0.0) {
+      lsum[0] += log10(st/sb);
+      lsum[1] += SQR(log10(st/sb));
+      lsum[2] += log10(st/sg);
+      lsum[3] += SQR(log10(st/sg));
+      n++;
+    }
+  }
+
+  free_1d_array((void*) k);
+
+  stats_chaos(cut_b, cut_t, st_cut, lsum, n);
+
+  return;
+}
+
+
+/* this function makes the field lines; it essentially does all the
+   work.  I've found that the field lines can become chaotic; this is
+   really distracting in movies since they tend to flick around.  so
+   this function initializes a "bundle" of nearby field lines and
+   integrates all of them.  I cut off the main field line when the
+   width of the bundle reaches chaos_cut.  (or, with CHAOS_TANGENT,
+   when the width a bundle would have reaches tangent_cut; see
+   lines.h.)
+
+   the perturbations of the bundle depend only on rng_seed, the line
+   number and the bundle member, so a line comes out the same however
+   the lines are shared out among threads.  the reasons the line
+   stopped going forward and backward are returned in stop[0] and
+   stop[1].
+
+   attributes are sampled along the main line as soon as it is
+   traced, before the bundle pulls other parts of the field into
+   cache: |B| comes straight out of the RK4 steps, and the scalars are
+   interpolated at every point. */
+void integrate_line(Real3Vect *xvals, float **attr, int line, int *stop)
+{
+  int i,j,a,dir,nb;
+
+  Scratch *sc;
+  Real3Vect **bundle = NULL;
+  double t0, *kick;
+  float *bmag = NULL, *growth = NULL;
+
+  sc = scratch_local();
+  if (chaos_method != CHAOS_BUNDLE) {
+    if (sc->growth == NULL) {
+      sc->growth = (float*) calloc_1d_array(maxstep, sizeof(float));
+      stats_alloc(1, maxstep*sizeof(float));
+    }
+    growth = sc->growth;
+  }
+
+  /* initialize a bundle of nearby field lines, in this thread's
+     scratch space */
+  nb = (chaos_method == CHAOS_TANGENT) ? 0 : nbundle;
+  if (nb > 0) {
+    scratch_bundle(sc, nb);
+    bundle = sc->bundle;
+    kick = sc->kick;
+    random_normal_block(rng_seed, RNG_BUNDLE, line, nb, 0.0, KICK, kick);
+
+    for (i=0; i<nb; i++) {
+      bundle[i][maxstep/2] = xvals[maxstep/2];
+
+      bundle[i][maxstep/2].x1 += kick[4*i];
+      bundle[i][maxstep/2].x2 += kick[4*i+1];
+      bundle[i][maxstep/2].x3 += kick[4*i+2];
+    }
+  }
+
+
+  /* integrate every line in the bundle.  only the main line stops
+     short of its neighbours. */
+  for (a=0; attr != NULL && a<nattr; a++)
+    if (attr_src[a] == NULL) bmag = attr[a];
+
+  t0 = trace_begin();
+  RK4_integrate(xvals, bmag, growth, d_test, stop);
+  trace_end("main line", t0, -1);
+  cache_visit(line, xvals);
+
+  for (a=0; attr != NULL && a<nattr; a++) {
+    if (attr_src[a] == NULL)
+      continue;
+    for (j=0; j<maxstep; j++)
+      if (xvals[j].x1 != -1.0)
+        attr[a][j] = interpolate_scalar(attr_src[a], &xvals[j]);
+  }
+
+  if (nb > 0) {
+    t0 = trace_begin();
+    for (i=0; i<nb; i++) {
+      trace_member(bundle[i], &sc->lo[i], &sc->hi[i]);
+      cache_visit(line, bundle[i]);
+    }
+    trace_end("bundle", t0, nb);
+  }
+
+
+  /* cut off the main field line where the bundle starts to diverge,
+     first going forward, then backward. */
+  for (dir=1; dir>=-1; dir-=2) {
+    if (chaos_method == CHAOS_COMPARE)
+      chaos_compare(xvals, sc, growth, dir);
+
+    j = chaos_point(xvals, bundle,
+                    (chaos_method == CHAOS_TANGENT) ? growth : NULL, dir);
+    if (j != ((dir > 0) ? maxstep : 0) && xvals[j].x1 != -1.0)
+      stop[dir > 0 ? 0 : 1] = STOP_CHAOS;   /* still going when cut off */
+    while (j != ((dir > 0) ? maxstep : 0)) {
+      xvals[j].x1 = xvals[j].x2 = xvals[j].x3 = -1.0;
+      j += dir;
+    }
+  }
+
+  /* leave the bundle zeroed for the next line */
+  for (i=0; i<nb; i++)
+    memset(&bundle[i][sc->lo[i]], 0,
+           (sc->hi[i] - sc->lo[i] + 1)*sizeof(Real3Vect));
+
+  return;
+}
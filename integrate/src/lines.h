@@ -0,0 +1,146 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+#include "alias.h"
+#include "random.h"
+#include "rk4.h"
+#include "sep.h"
+#include "trace.h"
+#include "cache.h"
+
+/* variables defined in vtk.c */
+extern int Nx, Ny, Nz;          /* size of the grid in cell coordinates */
+extern double dx, dy, dz;       /* size of each cell in physical coordinates */
+extern Real3Vect ***B;          /* magnetic field */
+extern float ***dye;            /* passive scalar, if present */
+
+/* the variables below are defined in lines.c and read from the par
+   file in main.c.  integration parameters are documented in rk4.h */
+
+/* driver function integrates a "bundle" of nearby field lines to
+   detect when they become chaotic.  need to terminate before this
+   point if you want to make a movie */
+extern int nlines, nbundle;
+extern double chaos_cut, tangent_cut;
+
+/* how the spread of nearby lines is measured for chaos_cut.
+   CHAOS_BUNDLE traces nbundle lines kicked by about KICK in each
+   coordinate, and takes their rms distance from the main line at
+   each point.  CHAOS_TANGENT integrates the variational equations
+   along the main line instead (see RK4State.growth), which gives the
+   rms distance a bundle of many such lines would have while it is
+   still small; it costs about one line more, not nbundle.
+
+   the two are not interchangeable.  the bundle's spread at point j
+   includes how far its members have drifted along the line by taking
+   steps of their own, which the tangent one doesn't, so it is
+   usually far bigger, and by how much varies from field to field.
+   so the tangent spread is cut at a threshold of its own,
+   tangent_cut.  CHAOS_COMPARE does both, cuts as the bundle does, and
+   counts in stats how far apart the two cuts were, along with the
+   tangent_cut which would have cut where the bundle did, to calibrate
+   it for a given kind of field. */
+enum { CHAOS_BUNDLE, CHAOS_TANGENT, CHAOS_COMPARE };
+#define KICK (1.0e-2/lod)
+/* the default tangent_cut, in cells: where the tangent spread was,
+   on average, when bundles of 20 cut at chaos_cut = 5 on ABC fields */
+#define TANGENT_CUT 0.03
+extern int chaos_method;
+
+void integrate_line(Real3Vect *xvals, float **attr, int line, int *stop);
+
+/* the bundle takes nbundle*maxstep points, far too many to allocate
+   and fault in again for every line.  each thread keeps its own
+   scratch space instead: integrate_line() puts the bundle there and
+   leaves it zeroed for the next line, and a loop which makes its own
+   lines can take a main line (all -1.0) and room for its attributes
+   from scratch_line().  space is only allocated when a thread first
+   needs it, or more of it; stats counts those allocations.
+   scratch_init() makes room for every OpenMP thread; until it is
+   called there is one, for serial use. */
+void scratch_init(void);
+void scratch_free(void);
+Real3Vect *scratch_line(float ***attr);
+
+/* per-point attributes, recorded as the lines are traced and written
+   as extra columns after x, y and z.  attributes_init() takes a
+   comma-separated list: bmag is |B| (in units of the rms field),
+   which the integrator looks up anyway; dye is specific_scalar[0];
+   any other name is a SCALARS array in the vtk file, interpolated at
+   each point while the line is still in cache.  call it before the
+   file is read (it asks vtkread() for the scalars) and
+   attributes_bind() after.  integrate_line() then fills attr[a][j]
+   for xvals[j]; pass attr = NULL when nattr is 0. */
+#define MAXATTR 8
+extern int nattr;
+extern char *attr_name[MAXATTR];
+void attributes_init(char *names);
+void attributes_bind(void);
+void attributes_free(void);
+
+/* initial "seed" points for the field lines can be read from a file
+   or generated randomly.  random seeds are either uniform in the box
+   or weighted by |B|^seed_power or by the dye concentration, so that
+   fewer lines start out in regions where B ~ 0.  all random numbers
+   come from the counter-based generator in random.h, keyed by
+   rng_seed. */
+extern char *seed_weight;
+extern double seed_power;
+extern unsigned long rng_seed;
+int get_seed_points(char *seedfile, Real3Vect *seedpoints, int nseed);
+
+/* evenly spaced seeding: if d_sep > 0, seeds are taken in order and
+   skipped if they fall within d_sep of a line already traced; lines
+   stop once they come within d_test of another.  n_seed is then the
+   number of candidates and n_lines an upper limit. */
+extern double d_sep, d_test;
+
+/* a quick look: the field has been reduced by a factor lod (see
+   join_vtk -l), and vtk_file x.vtk is read as x.lod<lod>.vtk.  a cell
+   is then lod cells of the full grid; the lengths given in cells
+   (chaos_cut, close_lo, close_hi, d_sep, d_test and KICK) are taken
+   to be in cells of the full grid, and divided by lod, so that lines
+   are cut and closed about where the full run would do it.  seed
+   files, line_length and the output are in box units already. */
+extern int lod;
+
+/* normalize the magnetic field strength.  not strictly necessary,
+   but it makes the integration step size h have reasonable units. */
+void normalize_B(void);
+
+/* write the field line data to a file such that gnuplot's "splot"
+   command can read it.  attr[line] is as in integrate_line(), or
+   attr is NULL. */
+void write_data(char *outfname, Real3Vect **xvals, float ***attr);
+
+/* write one line the same way, ending with its blank line; attr is
+   as in integrate_line() */
+void write_line(FILE *outfile, Real3Vect *xvals, float **attr);
+
+/* which points of a line get written.  with simplify = 0, every point
+   at least a cell from the last one written.  with simplify > 0, as
+   few as keep every dropped point within simplify cells of the
+   polyline through the rest (Douglas-Peucker): straight stretches
+   shrink to their ends, and tight curls keep what they need.  xvals
+   has n points (maxstep, unless it has been trimmed); the indices go
+   into keep[], and the number of them is returned.  print_line()
+   writes them. */
+extern double simplify;
+int simplify_line(Real3Vect *xvals, int n, int *keep);
+void print_line(FILE *outfile, Real3Vect *xvals, float **attr,
+                int *keep, int n);
+
+/* put .tag before the extension of fname: cloud.0100.flines ->
+   cloud.0100.<tag>.flines.  for runs with several outputs. */
+void tag_name(char *fname, char *tag, char *name);
+
+#endif
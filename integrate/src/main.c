@@ -7,39 +7,18 @@
 #include "ath_array.h"
 #include "ath_error.h"
 #include "ath_vtk.h"
-#include "random.h"
 #include "rk4.h"
+#include "sep.h"
+#include "stats.h"
+#include "trace.h"
+#include "lines.h"
+#include "mpi_lines.h"
+#include "domain.h"
+#include "sweep.h"
+#include "serve.h"
+#include "writer.h"
 #include "par.h"
 
-/* variables defined in vtk.c */
-extern int Nx, Ny, Nz;          /* size of the grid in cell coordinates */
-extern double dx, dy, dz;       /* size of each cell in physical coordinates */
-extern Real3Vect ***B;          /* magnetic field */
-
-/* required for integration.  see RK4.h for documentation */
-int maxstep;
-double maxlen, tolerance;
-double close_lo, close_hi, xeno;
-
-/* driver function integrates a "bundle" of nearby field lines to
-   detect when they become chaotic.  need to terminate before this
-   point if you want to make a movie */
-static int nlines, nbundle;
-static double chaos_cut;
-void integrate_line(Real3Vect *xvals);
-
-/* initial "seed" points for the field lines can be read from a file
-   or generated randomly */
-void get_seed_points(char *seedfile, Real3Vect *seedpoints, int nseed);
-
-/* normalize the magnetic field strength.  not strictly necessary,
-   but it makes the integration step size h have reasonable units. */
-void normalize_B();
-
-/* write the field line data to a file such that gnuplot's "splot"
-   command can read it. */
-void write_data(char *outfname, Real3Vect **xvals);
-
 
 /* ========================================================================== */
 /* main(): mostly orchestrates input and output */
@@ -47,17 +26,34 @@ int main (int argc, char *argv[])
 {
   FILE *fp;
 
-  int i, j;
+  int i, j, n, c, ncfg, f, run;
   Real3Vect **xvals, *seedpoints;
-  int nseed;
-
-  char *vtkfile, *seedfile, *outfname, buf[512];
+  float ***attr;
+  int nseed, stop[2], ntrace;
+  int myid = 0, nproc = 1, chunk = 1;
+  int decompose = 0;
+  int stream;
+#ifdef MPI_PARALLEL
+  int ghost, ntile;
+#endif
+  double t, t0;
+
+  char *vtkfile, *seedfile, *outfname, *statfile, *tracefile, buf[512];
+  char *sweepfile, *vectors, *attributes, fieldname[512], cfgname[512];
+  char names[256];
+  char *servename, *cache_in, *cache_out, *tableau, *kernel, *chaos;
+  int cache_brick;
+  double cache_tol;
+  int roi = 0, margin = 0;
+  double roi_x[2][3];
+  char *rms;
+  FILE *sweepfp = NULL;
 
   char *definput = "input.fline";         /* default input filename */
   char *athinput = definput;
 
 
-  srand(-4);
+  t = wall_time();
 
   /* parse command line options */
   for (i=1; i<argc; i++) {
@@ -72,284 +68,521 @@ int main (int argc, char *argv[])
     }
   }
 
-  par_open(athinput);
-  par_cmdline(argc, argv);
+#ifdef MPI_PARALLEL
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+  MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+#endif
+
+  /* only rank 0 reads the input file, and passes it on to the others */
+  if (myid == 0) {
+    par_open(athinput);
+
+    /* -p integration/<name>=v1,v2,... adds <name> to the sweep.  do
+       this first: par_cmdline() takes its arguments apart. */
+    for (i=1; i<argc-1; i++) {
+      if (strcmp(argv[i], "-p") != 0)
+        continue;
+      strncpy(buf, argv[i+1], sizeof(buf)-1);
+      buf[sizeof(buf)-1] = '\0';
+      if (strncmp(buf, "integration/", 12) != 0 || strchr(buf, '=') == NULL)
+        ath_error("-p wants integration/<name>=v1,v2,..., not %s\n", buf);
+      *strchr(buf, '=') = '\0';
+      if (sweep_par(buf+12) < 0) {
+        for (n=0, names[0]='\0'; n<NSWEEP; n++)
+          sprintf(names + strlen(names), "%s%s", n ? ", " : "",
+                  sweep_name_of(n));
+        ath_error("-p can't sweep %s; only %s\n", buf+12, names);
+      }
+      par_sets("sweep", buf+12, buf + strlen(buf) + 1, "from -p");
+    }
+
+    par_cmdline(argc, argv);
+  }
+#ifdef MPI_PARALLEL
+  par_dist_mpi(myid, MPI_COMM_WORLD);
+#endif
 
 
   /* read the input file */
   vtkfile  = par_gets("files", "vtk_file");
+  lod      = par_geti_def("files", "lod", 1);
+  if (lod < 1)
+    ath_error("lod = %d: it's the factor the field was reduced by\n", lod);
+  if (lod > 1) {
+    /* x.vtk -> x.lod2.vtk, as join_vtk -l names it */
+    n = strlen(vtkfile);
+    if (n > 4 && strcmp(vtkfile + n-4, ".vtk") == 0)
+      vtkfile[n-4] = '\0';
+    sprintf(buf, "%s.lod%d.vtk", vtkfile, lod);
+    free(vtkfile);
+    vtkfile = ath_strdup(buf);
+  }
+  vectors  = par_gets_def("files", "vectors", "cell_centered_B");
+  attributes = par_gets_def("files", "attributes", "");
   sprintf(buf, "%s.flines", vtkfile);
   outfname = par_gets_def("files", "out_file", buf);
+  statfile = par_gets_def("files", "stats_file", NULL);
+  servename = par_gets_def("files", "serve", NULL);
+  simplify  = par_getd_def("files", "simplify",  0.0);
+  cache_in  = par_gets_def("files", "cache_in",  NULL);
+  cache_out = par_gets_def("files", "cache_out", NULL);
+  stream    = par_geti_def("files", "stream",    1);
+
+  tracefile = par_gets_def("files", "trace_file", NULL);
+  ntrace    = par_geti_def("files", "trace_events", 65536);
+
+  /* only read the part of the field around a region of interest, if
+     any of its bounds are given (physical units, like the seeds) */
+  for (n=0; n<6; n++) {
+    sprintf(buf, "x%d%s", n/2+1, (n%2) ? "max" : "min");
+    if (par_exist("roi", buf)) {
+      roi = 1;
+      roi_x[n%2][n/2] = par_getd("roi", buf);
+    } else {
+      roi_x[n%2][n/2] = (n%2) ? HUGE_VAL : -HUGE_VAL;
+    }
+  }
+  if (roi) {
+    margin = par_geti_def("roi", "margin", 2);
+
+    /* without the rms of B over the whole box, all of B is read for
+       it (see ath_vtk.h) */
+    rms = par_gets_def("roi", "b_rms", "");
+    vtk_roi_rms(rms);
+    free(rms);
+  }
 
   nseed    = par_geti_def("initial_condition", "n_seed",    1000);
   seedfile = par_gets_def("initial_condition", "seed_file", NULL);
 
+  seed_weight = par_gets_def("initial_condition", "seed_weight", "uniform");
+  seed_power  = par_getd_def("initial_condition", "seed_power",  1.0);
+  rng_seed    = par_geti_def("initial_condition", "rng_seed",    1);
+
+  d_sep  = par_getd_def("initial_condition", "d_sep",  0.0);
+  d_test = par_getd_def("initial_condition", "d_test", 0.5*d_sep);
+  d_sep  /= lod;
+  d_test /= lod;
+
   maxstep = par_geti_def("integration", "step_limit",  20000);
   maxlen  = par_getd_def("integration", "line_length", 1.0);
   nlines  = par_geti_def("integration", "n_lines",     100);
 
   nbundle   = par_geti_def("integration", "n_bundle",  100);
   chaos_cut = par_getd_def("integration", "chaos_cut", 5.0);
+  tangent_cut = par_getd_def("integration", "tangent_cut", TANGENT_CUT);
+  chaos     = par_gets_def("integration", "chaos",     "bundle");
+  if (strcmp(chaos, "bundle") == 0)
+    chaos_method = CHAOS_BUNDLE;
+  else if (strcmp(chaos, "tangent") == 0)
+    chaos_method = CHAOS_TANGENT;
+  else if (strcmp(chaos, "compare") == 0)
+    chaos_method = CHAOS_COMPARE;
+  else
+    ath_error("chaos = %s: use bundle, tangent or compare\n", chaos);
+  free(chaos);
 
   xeno     = par_getd_def("integration", "xeno",     1.0e-6);
   close_lo = par_getd_def("integration", "close_lo", 1.0);
   close_hi = par_getd_def("integration", "close_hi", 4.0);
+  chaos_cut /= lod;
+  tangent_cut /= lod;
+  close_lo  /= lod;
+  close_hi  /= lod;
 
   tolerance = par_getd_def("integration", "tolerance", 1.0e-6);
 
-  par_dump(2, stdout);
-  par_close();
+  cache_brick = par_geti_def("integration", "cache_brick", 16);
+  cache_tol   = par_getd_def("integration", "cache_tol",   0.0);
 
+  tableau = par_gets_def("integration", "tableau",       "rk4");
+  kernel  = par_gets_def("integration", "interpolation", "linear");
 
-  /* read the VTK file */
-  fp = fopen(vtkfile, "r");
-  vtkread(fp);
-  fclose(fp);
+  null_bmax  = par_getd_def("integration", "null_bmax",  0.0);
+  null_brick = par_geti_def("integration", "null_brick", 4);
 
+  huge_pages    = par_geti_def("integration", "huge_pages",    1);
+  numa_replicas = par_geti_def("integration", "numa_replicas", 0);
 
-  /* put maxlen and B in "cell" units */
-  maxlen *= Nx;
-  normalize_B();
+#ifdef MPI_PARALLEL
+  chunk = par_geti_def("integration", "mpi_chunk", 4);
 
+  decompose = par_geti_def("integration", "decompose", 0);
+  ghost     = par_geti_def("integration", "ghost",     4);
+  ntile     = par_geti_def("files",       "vtk_tiles", 0);
+#endif
 
-  /* initial condition for the field lines */
-  seedpoints = (Real3Vect*) calloc_1d_array(nseed, sizeof(Real3Vect));
-  get_seed_points(seedfile, seedpoints, nseed);
-
+  ncfg = sweep_init();
+  sprintf(buf, "%s.sweep", outfname);
+  sweepfile = par_gets_def("files", "sweep_table", buf);
 
-  /* allocate memory for the trajectories and initialize everything to -1.0 */
-  xvals = (Real3Vect**)calloc_2d_array(nlines, maxstep, sizeof(Real3Vect));
-  for (i=0; i<nlines; i++) {
-    for (j=0; j<maxstep; j++) {
-      xvals[i][j].x1 = xvals[i][j].x2 = xvals[i][j].x3 = -1.0;
-    }
-  }
+  if (myid == 0)
+    par_dump(2, stdout);
+  par_close();
 
-  /* initialize halfway through the array using seed points */
-  for (i=0; i < nlines; i++)
-    xvals[i][maxstep/2] = seedpoints[i];
+  if (nproc > 1 && servename != NULL)
+    ath_error("serve needs a single MPI rank\n");
+  if (nproc > 1 && d_sep > 0.0)
+    ath_error("evenly spaced seeding (d_sep > 0) needs a single MPI rank\n");
+  if (chunk < 1)
+    ath_error("mpi_chunk must be at least 1, not %d\n", chunk);
+  vtk_fields(vectors);
+  free(vectors);
+  attributes_init(attributes);
+  free(attributes);
+
+  if (decompose && nfield > 1)
+    ath_error("decompose reads one field at a time, not %d\n", nfield);
+  if (decompose && nattr > 0)
+    ath_error("attributes are not recorded with decompose\n");
+  if (decompose && numa_replicas)
+    ath_error("numa_replicas copies the whole field; not with decompose\n");
+  if (decompose && null_bmax > 0.0)
+    ath_error("null_bmax maps the whole field; not with decompose\n");
+  if (decompose && strlen(vtkfile) > 4 &&
+      strcmp(vtkfile + strlen(vtkfile)-4, ".vti") == 0)
+    ath_error("decompose reads legacy vtk files, not %s\n", vtkfile);
+  if (decompose && roi)
+    ath_error("decompose reads its own slabs; no roi with decompose\n");
+  if (decompose && chaos_method != CHAOS_BUNDLE)
+    ath_error("decompose only cuts lines with the bundle (chaos = bundle)\n");
+  if ((cache_in != NULL || cache_out != NULL) &&
+      (nproc > 1 || decompose || d_sep > 0.0 || ncfg > 1 || nfield > 1 ||
+       nattr > 0 || null_bmax > 0.0 || roi))
+    ath_error("cache_in and cache_out are for plain serial runs: no MPI, "
+              "d_sep, sweeps, several vectors, attributes, null_bmax "
+              "or roi\n");
+  if (decompose && seedfile == NULL && strcmp(seed_weight, "uniform") != 0)
+    ath_error("seed_weight = %s needs the whole field; not with decompose\n",
+              seed_weight);
+
+  stats_init(nlines);
+  scratch_init();
+  if (tracefile != NULL)
+    trace_init(ntrace);
+  stats_phase(PHASE_PARSE, wall_time() - t);
 
 
-  /* integrate the streamlines */
-  for (i=0; i<nlines; i++) {
-    printf("integrating line %d...\n", i);
-    integrate_line(xvals[i]);
+  /* read the VTK file */
+  t = wall_time();
+#ifdef MPI_PARALLEL
+  if (decompose) {
+    /* each rank only reads its own slab */
+    domain_load(vtkfile, ntile, ghost);
+  } else
+#endif
+  {
+    if (roi)
+      vtk_roi(roi_x[0], roi_x[1], margin);
+    if ((fp = fopen(vtkfile, "r")) == NULL)
+      ath_error("could not open vtk file %s\n", vtkfile);
+    vtkread(fp);
+    fclose(fp);
   }
+  attributes_bind();
+  RK4_init(tableau, kernel);
+  free(tableau);
+  free(kernel);
+  stats_phase(PHASE_LOAD, wall_time() - t);
+  trace_end("vtkread", t, -1);
 
 
-  /* save the data to disk */
-  write_data(outfname, xvals);
-
-  /* Free the arrays used by read_vtk */
-  cleanup_vtk();
-  free_1d_array((void*)  seedpoints);
-  free_2d_array((void**) xvals);
+  /* put maxlen and B in "cell" units */
+  t = wall_time();
+  maxlen *= Nx_all;
+#ifdef MPI_PARALLEL
+  if (decompose)
+    domain_normalize_B();
+  else
+#endif
+  {
+    for (f=0; f<nfield; f++) {
+      B = field[f];
+      normalize_B();
+    }
+    B = field[0];
+  }
+  stats_phase(PHASE_NORMALIZE, wall_time() - t);
+  trace_end("normalize_B", t, -1);
+
+  /* where lines would only creep around nulls (see nulls.h) */
+  if (null_bmax > 0.0) {
+    t = wall_time();
+    nulls_init();
+    stats_phase(PHASE_NORMALIZE, wall_time() - t);
+    trace_end("nulls_init", t, -1);
+  }
 
-  return 0;
-}
-/* ========================================================================== */
+  /* a copy of the field for every memory node, if asked (see numa.h) */
+  if (numa_replicas) {
+    t = wall_time();
+    numa_replicate();
+    stats_phase(PHASE_NORMALIZE, wall_time() - t);
+    trace_end("numa_replicate", t, -1);
+  }
 
 
-/* write the field line data to a file such that gnuplot's "splot"
-   command can read it:
+  /* server mode: trace whatever seeds the clients send in, until one
+     of them says stop (see serve.h).  lines aren't checked against
+     each other, so d_sep and d_test don't apply. */
+  if (servename != NULL) {
+    d_test = 0.0;
+    serve_run(servename);
 
-   - each line contains x, y, and z coordinates for a single point,
-     separated by spaces.
+    if (statfile != NULL) {
+      if ((fp = fopen(statfile, "w")) == NULL)
+        ath_error("could not open stats file %s\n", statfile);
+      stats_write(fp);
+      fclose(fp);
+    }
 
-   - different field lines are separated by blank lines.
+    numa_free();
+    nulls_free();
+    cleanup_vtk();
+    attributes_free();
+    scratch_free();
+    free(seed_weight);
+    free(servename);
+    sweep_free();
+    stats_free();
+    trace_free();
+#ifdef MPI_PARALLEL
+    MPI_Finalize();
+#endif
+    return 0;
+  }
 
-   - for economy, I don't output points closer than 1 cell.
 
-   - output points in a unit system where x, y, and z go from -1 to 1.
-     this makes plotting easier later, but may not be what I want.
-*/
-void write_data(char *outfname, Real3Vect **xvals)
-{
-  int i, j;
+  /* initial condition for the field lines */
+  t = wall_time();
+  seedpoints = (Real3Vect*) calloc_1d_array(nseed, sizeof(Real3Vect));
+  nseed = get_seed_points(seedfile, seedpoints, nseed);
+  if (nseed == 0)
+    ath_error("no seeds to trace (n_seed, the seed file or the roi)\n");
+  if (nseed < nlines && d_sep <= 0.0) {
+    printf("only %d seeds: tracing %d lines, not %d\n", nseed, nseed, nlines);
+    nlines = nseed;
+  }
+  stats_phase(PHASE_SEED, wall_time() - t);
+  trace_end("get_seed_points", t, -1);
 
-  FILE *outfile;
-  Real3Vect last_output;
 
-  outfile = fopen(outfname, "w");
-  for (i=0; i<nlines; i++) {
-    last_output.x1 = last_output.x2 = last_output.x3 = -10.0;
+  /* lines which can be copied from the last snapshot (see cache.h) */
+  if (cache_in != NULL || cache_out != NULL) {
+    t = wall_time();
+    cache_init(cache_brick, cache_tol);
+    if (cache_in != NULL)
+      cache_load(cache_in);
+    trace_end("cache_load", t, -1);
+  }
 
-    for (j=0; j<maxstep; j++) {
 
-      if (xvals[i][j].x1 > 0.0 &&
-          xvals[i][j].x2 > 0.0 &&
-          xvals[i][j].x3 > 0.0) {
+  /* lines can go to the writer thread as they're finished (see
+     writer.h), when nothing needs all of them at the end */
+  stream = stream && nproc == 1 && !decompose && d_sep <= 0.0 &&
+    ncfg == 1 && cache_in == NULL && cache_out == NULL;
 
-        if (dist(&xvals[i][j], &last_output) > 1.0) {
+  /* allocate memory for the trajectories.  with MPI, the workers
+     keep their own chunk-sized buffers and only rank 0 holds every
+     line, unless the domain is decomposed.  streamed lines are
+     traced in each thread's scratch space (see lines.h). */
+  xvals = NULL;
+  if (!stream && (myid == 0 || decompose))
+    xvals = (Real3Vect**)calloc_2d_array(nlines, maxstep, sizeof(Real3Vect));
 
-          fprintf(outfile, "%f\t%f\t%f\n",
-                  xvals[i][j].x1/Nx - 0.5,
-                  xvals[i][j].x2/Ny - 0.5,
-                  xvals[i][j].x3/Nz - 0.5);
+  attr = NULL;
+  if (!stream && myid == 0 && nattr > 0)
+    attr = (float***)calloc_3d_array(nlines, nattr, maxstep, sizeof(float));
 
-          last_output = xvals[i][j];
-        }
-      }
-    }
-    fprintf(outfile, "\n");
+  if (myid == 0 && ncfg > 1) {
+    if ((sweepfp = fopen(sweepfile, "w")) == NULL)
+      ath_error("could not open sweep table %s\n", sweepfile);
   }
-  fprintf(outfile, "\n");
-  fclose(outfile);
 
-  return;
-}
-
-
-void normalize_B()
-{
-  double B2, Brms;
-  int i, j, k;
-
-  Brms = 0.0;
-  for(k=0; k<Nz; k++){
-    for(j=0; j<Ny; j++){
-      for(i=0; i<Nx; i++){
-        B2 = (SQR(B[k][j][i].x1) +
-              SQR(B[k][j][i].x2) +
-              SQR(B[k][j][i].x3));
-        Brms += B2;
+  /* trace every field, in every configuration in the sweep (just
+     one of each, usually) from the same seeds */
+  for (run=0; run<nfield*ncfg; run++) {
+    f = run / ncfg;
+    c = run % ncfg;
+
+    if (nfield > 1) {
+      B = field[f];
+      tag_name(outfname, field_name[f], fieldname);
+      if (c == 0) {
+        printf("tracing %s...\n", field_name[f]);
+        if (null_bmax > 0.0 && f > 0)
+          nulls_init();
+        if (sweepfp != NULL)
+          fprintf(sweepfp, "# field %s\n", field_name[f]);
       }
+    } else {
+      strcpy(fieldname, outfname);
     }
-  }
 
-  Brms = sqrt(Brms / (Nx*Ny*Nz));
+    sweep_set(c);
+    sweep_begin();
+    sweep_name(fieldname, c, cfgname);
 
-  for(k=0; k<Nz; k++){
-    for(j=0; j<Ny; j++){
-      for(i=0; i<Nx; i++){
-        B[k][j][i].x1 /= Brms;
-        B[k][j][i].x2 /= Brms;
-        B[k][j][i].x3 /= Brms;
+    /* initialize everything to -1.0 */
+    if (xvals != NULL) {
+      for (i=0; i<nlines; i++) {
+        for (j=0; j<maxstep; j++) {
+          xvals[i][j].x1 = xvals[i][j].x2 = xvals[i][j].x3 = -1.0;
+        }
       }
     }
-  }
-
-  return;
-}
-
-
-/* set initial conditions for the field lines.  these can be
-   generated randomly or read in from a "seed file" written by
-   athena.  the format for the seed file is as follows:
 
-   # time = 17.960301
-   0    0.147636        0.127228        0.104124
-   1    0.020408        -0.260193       -0.021771
-   2    -0.140130       -0.028677       0.061697
-   3    -0.070474       -0.111080       -0.021247
-   4    0.113590        0.058400        0.154429
-   5    -0.055813       -0.248949       -0.052291
+    t = wall_time();
+    if (d_sep > 0.0) {
+      /* evenly spaced: only trace candidates which are far enough from
+         the lines we already have */
+      sep_init(d_sep);
+
+      for (i=0, n=0; i < nseed && n < nlines; i++) {
+        if (!in_bounds(&seedpoints[i]) || sep_near(&seedpoints[i], d_sep))
+          continue;
+
+        printf("integrating line %d (seed %d)...\n", n, i);
+        xvals[n][maxstep/2] = seedpoints[i];
+        t0 = trace_begin();
+        integrate_line(xvals[n], (attr != NULL) ? attr[n] : NULL, n, stop);
+        trace_end("integrate_line", t0, n);
+        stats_line(n, stop);
+        sep_add_line(xvals[n], maxstep);
+        n++;
+      }
+      printf("evenly spaced seeding: kept %d of %d candidates.\n", n, i);
+
+      sep_free();
+#ifdef MPI_PARALLEL
+    } else if (decompose) {
+      /* lines move from rank to rank as they cross the slabs */
+      domain_integrate(xvals, seedpoints);
+    } else if (nproc > 1) {
+      /* rank 0 hands out chunks of lines and collects them in order */
+      mpi_integrate(xvals, attr, seedpoints, chunk);
+#endif
+    } else if (stream) {
+      writer_open(cfgname);
+
+#pragma omp parallel for schedule(dynamic) private(stop, t0)
+      for (i=0; i<nlines; i++) {
+        Real3Vect *line;
+        float **la;
+
+        line = scratch_line(&la);
+        line[maxstep/2] = seedpoints[i];
+
+        printf("integrating line %d...\n", i);
+        t0 = trace_begin();
+        integrate_line(line, la, i, stop);
+        trace_end("integrate_line", t0, i);
+        stats_line(i, stop);
+        writer_put(i, line, la);
+      }
 
-   each row gives a point (labeled by an integer) and x, y, and z
-   coordinates (as %f, not %lf) in physical (not cell) coordinates.
-*/
-void get_seed_points(char *seedfile, Real3Vect *seedpoints, int nseed)
-{
-  int i, ignore;
-  FILE *fp;
-  char buf[512];
-  Real3Vect temp;
-
-  if (seedfile != NULL) {
-    fp = fopen(seedfile, "r");
-    if (fp == NULL)
-      ath_error("could not open seed file %s\n", seedfile);
-
-    i=0;
-    while(fgets(buf, sizeof(buf), fp) != NULL){
-      if (sscanf(buf, "%d %le %le %le",
-                 &ignore,
-                 &temp.x1, &temp.x2, &temp.x3) == 4){
-        if (i < nseed){
-          /* convert to cell units */
-          seedpoints[i].x1 = (temp.x1 - ox)/dx;
-          seedpoints[i].x2 = (temp.x2 - oy)/dy;
-          seedpoints[i].x3 = (temp.x3 - oz)/dz;
-
-          i++;
+      /* what's left to write after the last line is traced */
+      t0 = wall_time();
+      stats_phase(PHASE_WRITE, writer_close());
+      trace_end("write_data", t0, run);
+    } else {
+      /* initialize halfway through the array using seed points */
+      for (i=0; i < nlines; i++)
+        xvals[i][maxstep/2] = seedpoints[i];
+
+
+      /* integrate the streamlines.  lines take very different amounts
+         of time, so hand them out one at a time */
+#pragma omp parallel for schedule(dynamic) private(stop, t0)
+      for (i=0; i<nlines; i++) {
+        if (cache_reuse(i, xvals[i], stop)) {
+          stats_line(i, stop);
+          continue;
         }
+
+        printf("integrating line %d...\n", i);
+        t0 = trace_begin();
+        integrate_line(xvals[i], (attr != NULL) ? attr[i] : NULL, i, stop);
+        trace_end("integrate_line", t0, i);
+        cache_line(i, stop);
+        stats_line(i, stop);
       }
     }
-    fclose(fp);
-  } else {                      /* seedfile == NULL */
-    for (i=0; i<nseed; i++) {
-      seedpoints[i].x1 = Nx * RandomReal();
-      seedpoints[i].x2 = Ny * RandomReal();
-      seedpoints[i].x3 = Nz * RandomReal();
-    }
-  }
-
-  return;
-}
+    stats_phase(PHASE_INTEGRATE, wall_time() - t);
 
 
-/* this function makes the field lines; it essentially does all the
-   work.  I've found that the field lines can become chaotic; this is
-   really distracting in movies since they tend to flick around.  so
-   this function initializes a "bundle" of nearby field lines and
-   integrates all of them.  I cut off the main field line when the
-   width of the bundle reaches chaos_cut. */
-void integrate_line(Real3Vect *xvals)
-{
-  int i,j;
-
-  Real3Vect **bundle;
-  double sigma;
-
-  /* initialize a bundle of nearby field lines */
-  bundle = (Real3Vect**) calloc_2d_array(nbundle, maxstep, sizeof(Real3Vect));
-  for (i=0; i<nbundle; i++) {
-    bundle[i][maxstep/2] = xvals[maxstep/2];
+    /* save the data to disk */
+    if (myid == 0 && !stream) {
+      t = wall_time();
+      write_data(cfgname, xvals, attr);
+      if (cache_out != NULL)
+        cache_save(cache_out, xvals, seedpoints);
+      stats_phase(PHASE_WRITE, wall_time() - t);
+      trace_end("write_data", t, run);
+    }
 
-    bundle[i][maxstep/2].x1 += RandomNormal(0.0, 1.0e-2);
-    bundle[i][maxstep/2].x2 += RandomNormal(0.0, 1.0e-2);
-    bundle[i][maxstep/2].x3 += RandomNormal(0.0, 1.0e-2);
+    if (ncfg > 1)
+      sweep_row(sweepfp, c, xvals);
   }
 
-
-  /* integrate every line in the bundle */
-  RK4_integrate(xvals);
-  for (i=0; i<nbundle; i++)
-    RK4_integrate(bundle[i]);
-
-
-  /* cut off the main field line where the bundle starts to diverge. */
-  /*   first, going forward... */
-  for (j=maxstep/2; j<maxstep; j++) {
-    sigma = 0.0;
-    for (i=0; i<nbundle; i++) {
-      sigma += SQR(dist(&xvals[j], &bundle[i][j]));
-    }
-    sigma = sqrt(sigma/nbundle);
-    if (sigma > chaos_cut)
-      break;
+  if (sweepfp != NULL) {
+    printf("sweep: %d configurations; see %s\n", ncfg, sweepfile);
+    fclose(sweepfp);
   }
-  while (j<maxstep) {
-    xvals[j].x1 = xvals[j].x2 = xvals[j].x3 = -1.0;
-    j++;
+
+#ifdef MPI_PARALLEL
+  stats_reduce_mpi(MPI_COMM_WORLD);
+#endif
+
+  /* summary of the run, as JSON */
+  if (myid != 0) {
+    /* the totals are on rank 0 */
+  } else if (statfile != NULL) {
+    if ((fp = fopen(statfile, "w")) == NULL)
+      ath_error("could not open stats file %s\n", statfile);
+    stats_write(fp);
+    fclose(fp);
+  } else {
+    stats_write(stdout);
   }
 
-    /*   ...then backward */
-  for (j=maxstep/2; j>0; j--) {
-    sigma = 0.0;
-    for (i=0; i<nbundle; i++) {
-      sigma += SQR(dist(&xvals[j], &bundle[i][j]));
+  if (tracefile != NULL) {
+    /* one timeline per rank: rank n > 0 writes <trace_file>.n */
+    if (myid != 0) {
+      sprintf(buf, "%s.%d", tracefile, myid);
+      tracefile = buf;
     }
-    sigma = sqrt(sigma/nbundle);
-    if (sigma > chaos_cut)
-      break;
-  }
-  while (j>0) {
-    xvals[j].x1 = xvals[j].x2 = xvals[j].x3 = -1.0;
-    j--;
+    if ((fp = fopen(tracefile, "w")) == NULL)
+      ath_error("could not open trace file %s\n", tracefile);
+    trace_write(fp);
+    fclose(fp);
   }
 
-  free_2d_array((void**) bundle);
+  /* Free the arrays used by read_vtk */
+#ifdef MPI_PARALLEL
+  domain_free();
+#endif
+  cache_free();
+  numa_free();
+  nulls_free();
+  cleanup_vtk();
+  free_1d_array((void*)  seedpoints);
+  if (xvals != NULL)
+    free_2d_array((void**) xvals);
+  if (attr != NULL)
+    free_3d_array((void***) attr);
+  attributes_free();
+  scratch_free();
+  free(seed_weight);
+  sweep_free();
+  stats_free();
+  trace_free();
+
+#ifdef MPI_PARALLEL
+  MPI_Finalize();
+#endif
 
-  return;
+  return 0;
 }
+/* ========================================================================== */
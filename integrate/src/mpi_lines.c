@@ -0,0 +1,167 @@
+#include "mpi_lines.h"
+
+#ifdef MPI_PARALLEL
+
+#define TAG_WORK   1            /* master -> worker: range of lines */
+#define TAG_RESULT 2            /* worker -> master: finished lines */
+
+/* a result message is a flat array of doubles:
+
+     nline, then for each line:
+       line, first, npts, stop[0], stop[1], x1, x2, x3, x1, ...
+
+   holding the points xvals[first] ... xvals[first+npts-1], each
+   followed by its nattr attributes.  an empty message (nline = 0)
+   asks for the first chunk of work. */
+static int result_size(int chunk)
+{
+  return 1 + chunk*(5 + (3+nattr)*maxstep);
+}
+
+
+static void mpi_master(Real3Vect **xvals, float ***attr, int chunk, int nproc)
+{
+  MPI_Status status;
+  int next = 0, nworking = nproc-1;
+  int range[2], stop[2];
+  int l, nline, line, first, npts, j, p, a;
+  double *buf;
+
+  buf = (double*) calloc_1d_array(result_size(chunk), sizeof(double));
+
+  while (nworking > 0) {
+    MPI_Recv(buf, result_size(chunk), MPI_DOUBLE, MPI_ANY_SOURCE, TAG_RESULT,
+             MPI_COMM_WORLD, &status);
+
+    /* file away whatever came back... */
+    nline = (int) buf[0];
+    for (l=0, p=1; l<nline; l++) {
+      line  = (int) buf[p++];
+      first = (int) buf[p++];
+      npts  = (int) buf[p++];
+      stop[0] = (int) buf[p++];
+      stop[1] = (int) buf[p++];
+
+      for (j=first; j<first+npts; j++) {
+        xvals[line][j].x1 = buf[p++];
+        xvals[line][j].x2 = buf[p++];
+        xvals[line][j].x3 = buf[p++];
+        for (a=0; a<nattr; a++)
+          attr[line][a][j] = buf[p++];
+      }
+      stats_line(line, stop);
+    }
+
+    /* ...and send that rank the next chunk, or tell it to stop */
+    range[0] = next;
+    range[1] = MIN(next + chunk, nlines);
+    next = range[1];
+
+    MPI_Send(range, 2, MPI_INT, status.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
+
+    if (range[0] == range[1])
+      nworking--;
+  }
+
+  free_1d_array((void*) buf);
+
+  return;
+}
+
+
+static void mpi_worker(Real3Vect *seedpoints, int chunk)
+{
+  MPI_Status status;
+  Real3Vect **lines;
+  float ***attr = NULL;
+  int range[2], *stops;
+  int l, n, j, first, last, p, a;
+  double *buf, t0;
+
+  lines = (Real3Vect**) calloc_2d_array(chunk, maxstep, sizeof(Real3Vect));
+  if (nattr > 0)
+    attr = (float***) calloc_3d_array(chunk, nattr, maxstep, sizeof(float));
+  stops = (int*) calloc_1d_array(2*chunk, sizeof(int));
+  buf   = (double*) calloc_1d_array(result_size(chunk), sizeof(double));
+
+  /* ask for work */
+  buf[0] = 0.0;
+  MPI_Send(buf, 1, MPI_DOUBLE, 0, TAG_RESULT, MPI_COMM_WORLD);
+
+  while (1) {
+    MPI_Recv(range, 2, MPI_INT, 0, TAG_WORK, MPI_COMM_WORLD, &status);
+    if (range[0] >= range[1])
+      break;
+
+    n = range[1] - range[0];
+    t0 = trace_begin();
+
+#pragma omp parallel for schedule(dynamic) private(j)
+    for (l=0; l<n; l++) {
+      for (j=0; j<maxstep; j++)
+        lines[l][j].x1 = lines[l][j].x2 = lines[l][j].x3 = -1.0;
+      lines[l][maxstep/2] = seedpoints[range[0] + l];
+
+      printf("integrating line %d...\n", range[0] + l);
+      integrate_line(lines[l], (attr != NULL) ? attr[l] : NULL,
+                     range[0] + l, &stops[2*l]);
+    }
+
+    trace_end("chunk", t0, range[0]);
+
+    /* only send the part of each line that was integrated */
+    buf[0] = n;
+    for (l=0, p=1; l<n; l++) {
+      for (first=0; first<maxstep && lines[l][first].x1 == -1.0; first++) ;
+      for (last=maxstep-1; last>first && lines[l][last].x1 == -1.0; last--) ;
+      if (first == maxstep)
+        last = first-1;
+
+      buf[p++] = range[0] + l;
+      buf[p++] = first;
+      buf[p++] = last - first + 1;
+      buf[p++] = stops[2*l];
+      buf[p++] = stops[2*l+1];
+
+      for (j=first; j<=last; j++) {
+        buf[p++] = lines[l][j].x1;
+        buf[p++] = lines[l][j].x2;
+        buf[p++] = lines[l][j].x3;
+        for (a=0; a<nattr; a++)
+          buf[p++] = attr[l][a][j];
+      }
+    }
+
+    MPI_Send(buf, p, MPI_DOUBLE, 0, TAG_RESULT, MPI_COMM_WORLD);
+  }
+
+  free_2d_array((void**) lines);
+  if (attr != NULL)
+    free_3d_array((void***) attr);
+  free_1d_array((void*) stops);
+  free_1d_array((void*) buf);
+
+  return;
+}
+
+
+void mpi_integrate(Real3Vect **xvals, float ***attr,
+                   Real3Vect *seedpoints, int chunk)
+{
+  int myid, nproc;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+  MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+  if (nproc < 2)
+    ath_error("[mpi_integrate]: need at least two ranks\n");
+
+  if (myid == 0)
+    mpi_master(xvals, attr, chunk, nproc);
+  else
+    mpi_worker(seedpoints, chunk);
+
+  return;
+}
+
+#endif /* MPI_PARALLEL */
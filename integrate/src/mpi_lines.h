@@ -0,0 +1,28 @@
+#ifndef MPI_LINES_H
+#define MPI_LINES_H
+
+#ifdef MPI_PARALLEL
+
+#include <mpi.h>
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "stats.h"
+#include "trace.h"
+#include "lines.h"
+
+/* share the lines out among MPI ranks.
+
+   every rank loads the field and computes the same seed points.  rank
+   0 then acts as a master: it hands out chunks of `chunk' consecutive
+   lines to the other ranks as they ask for more work, and collects
+   the finished lines into xvals in seed order.  the workers integrate
+   the lines of each chunk with all of their threads.  xvals and attr
+   (the attributes of each line, or NULL; see lines.h) are only used
+   on rank 0. */
+void mpi_integrate(Real3Vect **xvals, float ***attr,
+                   Real3Vect *seedpoints, int chunk);
+
+#endif /* MPI_PARALLEL */
+
+#endif
@@ -0,0 +1,228 @@
+#include "nulls.h"
+
+#define MAXLEVEL 16
+
+double null_bmax = 0.0;
+int null_brick = 4;
+
+/* one level of the map: blocks of 2^l cells on a side */
+typedef struct Level_s{
+  int nx, ny, nz;
+  float *bmax;                  /* largest |B| in the block */
+  unsigned char *null;          /* the block may hold a null */
+}Level;
+
+static Level lev[MAXLEVEL];
+static int nlevel = 0;
+static unsigned char *dead = NULL;  /* at the top level */
+
+
+/* level 0, straight from the field: cell (i,j,k) has corners
+   (i..i+1, j..j+1, k..k+1) */
+static void nulls_cells(Level *l)
+{
+  int i, j, k, c, n;
+  Real3Vect *p;
+  double b2, bmax, lo[3], hi[3];
+
+#pragma omp parallel for private(i, j, c, n, p, b2, bmax, lo, hi)
+  for (k=0; k<l->nz; k++) {
+    for (j=0; j<l->ny; j++) {
+      for (i=0; i<l->nx; i++) {
+        bmax = 0.0;
+        for (c=0; c<3; c++) {
+          lo[c] =  HUGE_VAL;
+          hi[c] = -HUGE_VAL;
+        }
+
+        for (n=0; n<8; n++) {
+          p = &B[k + (n>>2)][j + ((n>>1)&1)][i + (n&1)];
+          b2 = SQR(p->x1) + SQR(p->x2) + SQR(p->x3);
+          bmax = MAX(bmax, b2);
+          lo[0] = MIN(lo[0], p->x1);  hi[0] = MAX(hi[0], p->x1);
+          lo[1] = MIN(lo[1], p->x2);  hi[1] = MAX(hi[1], p->x2);
+          lo[2] = MIN(lo[2], p->x3);  hi[2] = MAX(hi[2], p->x3);
+        }
+
+        n = (k*l->ny + j)*l->nx + i;
+        l->bmax[n] = sqrt(bmax);
+        l->null[n] = (lo[0] <= 0.0 && hi[0] >= 0.0 &&
+                      lo[1] <= 0.0 && hi[1] >= 0.0 &&
+                      lo[2] <= 0.0 && hi[2] >= 0.0);
+      }
+    }
+  }
+
+  return;
+}
+
+
+/* level up from level dn: each block is 2x2x2 blocks below (fewer at
+   the edges) */
+static void nulls_coarsen(Level *up, Level *dn)
+{
+  int i, j, k, n, m, a, b, c;
+  float bmax;
+  unsigned char null;
+
+#pragma omp parallel for private(i, j, n, m, a, b, c, bmax, null)
+  for (k=0; k<up->nz; k++) {
+    for (j=0; j<up->ny; j++) {
+      for (i=0; i<up->nx; i++) {
+        bmax = 0.0;
+        null = 0;
+        for (c=2*k; c<MIN(2*k+2, dn->nz); c++) {
+          for (b=2*j; b<MIN(2*j+2, dn->ny); b++) {
+            for (a=2*i; a<MIN(2*i+2, dn->nx); a++) {
+              m = (c*dn->ny + b)*dn->nx + a;
+              bmax = MAX(bmax, dn->bmax[m]);
+              null |= dn->null[m];
+            }
+          }
+        }
+
+        n = (k*up->ny + j)*up->nx + i;
+        up->bmax[n] = bmax;
+        up->null[n] = null;
+      }
+    }
+  }
+
+  return;
+}
+
+
+/* mark the weak bricks (bmax < null_bmax) which hold a null, and
+   every weak brick connected to one through the faces of other weak
+   bricks: the whole slow region a line would have to creep through.
+   returns how many there are. */
+static int nulls_flood(Level *l)
+{
+  int *queue, head, tail, n, m, i, j, k, d, ndead;
+  static const int step[6][3] = {
+    {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}
+  };
+
+  queue = (int*) calloc_1d_array(l->nx*l->ny*l->nz, sizeof(int));
+
+  head = tail = 0;
+  for (n=0; n < l->nx*l->ny*l->nz; n++) {
+    if (l->null[n] && l->bmax[n] < null_bmax) {
+      dead[n] = 1;
+      queue[tail++] = n;
+    }
+  }
+
+  while (head < tail) {
+    n = queue[head++];
+    i = n % l->nx;
+    j = (n / l->nx) % l->ny;
+    k = n / (l->nx*l->ny);
+
+    for (d=0; d<6; d++) {
+      if (i+step[d][0] < 0 || i+step[d][0] >= l->nx ||
+          j+step[d][1] < 0 || j+step[d][1] >= l->ny ||
+          k+step[d][2] < 0 || k+step[d][2] >= l->nz)
+        continue;
+      m = ((k+step[d][2])*l->ny + j+step[d][1])*l->nx + i+step[d][0];
+      if (!dead[m] && l->bmax[m] < null_bmax) {
+        dead[m] = 1;
+        queue[tail++] = m;
+      }
+    }
+  }
+  ndead = tail;
+
+  free_1d_array((void*) queue);
+
+  return ndead;
+}
+
+
+void nulls_init(void)
+{
+  int l, n, ncell, nbrick, ncand, ndead;
+
+  nulls_free();
+  if (null_bmax <= 0.0)
+    return;
+
+  for (nlevel=1; (1 << (nlevel-1)) < null_brick; nlevel++) ;
+  if ((1 << (nlevel-1)) != null_brick || nlevel > MAXLEVEL)
+    ath_error("[nulls_init]: null_brick = %d is not a power of 2 up to %d\n",
+              null_brick, 1 << (MAXLEVEL-1));
+
+  /* the mipmap */
+  for (l=0; l<nlevel; l++) {
+    if (l == 0) {
+      lev[l].nx = Nx-1;  lev[l].ny = Ny-1;  lev[l].nz = Nz-1;
+    } else {
+      lev[l].nx = (lev[l-1].nx + 1)/2;
+      lev[l].ny = (lev[l-1].ny + 1)/2;
+      lev[l].nz = (lev[l-1].nz + 1)/2;
+    }
+    n = lev[l].nx * lev[l].ny * lev[l].nz;
+    lev[l].bmax = (float*) calloc_1d_array(n, sizeof(float));
+    lev[l].null = (unsigned char*) calloc_1d_array(n, sizeof(unsigned char));
+
+    if (l == 0)
+      nulls_cells(&lev[0]);
+    else
+      nulls_coarsen(&lev[l], &lev[l-1]);
+  }
+
+  /* the dead bricks */
+  l = nlevel-1;
+  nbrick = lev[l].nx * lev[l].ny * lev[l].nz;
+  dead = (unsigned char*) calloc_1d_array(nbrick, sizeof(unsigned char));
+  ndead = nulls_flood(&lev[l]);
+
+  ncell = lev[0].nx * lev[0].ny * lev[0].nz;
+  for (n=0, ncand=0; n<ncell; n++)
+    ncand += lev[0].null[n];
+
+  printf("nulls: %d cells may hold a null; %d of %d bricks (%.1f%%) are dead\n",
+         ncand, ndead, nbrick, 100.0*ndead/nbrick);
+
+  return;
+}
+
+
+void nulls_free(void)
+{
+  int l;
+
+  for (l=0; l<nlevel; l++) {
+    free_1d_array((void*) lev[l].bmax);
+    free_1d_array((void*) lev[l].null);
+  }
+  nlevel = 0;
+
+  if (dead != NULL)
+    free_1d_array((void*) dead);
+  dead = NULL;
+
+  return;
+}
+
+
+int null_dead(Real3Vect *x)
+{
+  Level *l;
+  int i, j, k, s;
+
+  if (dead == NULL)
+    return 0;
+
+  l = &lev[nlevel-1];
+  s = nlevel-1;
+  if (x->x1 < 0.0 || x->x2 < 0.0 || x->x3 < 0.0)
+    return 0;
+  i = ((int) x->x1) >> s;
+  j = ((int) x->x2) >> s;
+  k = ((int) x->x3) >> s;
+  if (i >= l->nx || j >= l->ny || k >= l->nz)
+    return 0;
+
+  return dead[(k*l->ny + j)*l->nx + i];
+}
@@ -0,0 +1,43 @@
+#ifndef NULLS_H
+#define NULLS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+
+/* dead regions around magnetic nulls.
+
+   a line which runs into a null creeps along with tinier and tinier
+   steps until xeno or step_limit stops it, which can take thousands
+   of steps (and most of the "giving up" messages).  so after
+   normalize_B() a coarse map of the field is built, in parallel: for
+   every cell, the largest |B| at its corners and whether all three
+   components change sign across it (so that it may hold a null);
+   then the same for blocks of 2, 4, ... cells on a side, each level
+   from the one below, up to null_brick.
+
+   a brick of null_brick cells is weak if |B| (in units of the rms
+   field) stays below null_bmax everywhere in it.  the dead bricks are
+   the weak ones which may hold a null, and the weak ones connected to
+   those through other weak bricks: the slow region around each null,
+   but not weak field which lines can still cross.  random seeds which
+   land in a dead brick are drawn again, and lines stop (STOP_NULL) as
+   soon as they step into one.
+
+   null_bmax = 0, the default, turns all of this off. */
+extern double null_bmax;
+extern int null_brick;          /* a power of 2 */
+
+/* build the map for B, or drop it if null_bmax is 0 */
+void nulls_init(void);
+void nulls_free(void);
+
+/* is x (in cell units) in a dead brick? */
+int null_dead(Real3Vect *x);
+
+#endif
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "numa.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define MAXNODE    64
+#define HUGE_ALIGN (2 << 20)
+
+int huge_pages = 1;
+int numa_replicas = 0;
+
+__thread Real3Vect ***numa_from = NULL, ***numa_copy = NULL;
+__thread int numa_seen = 0;
+int numa_gen = 1;
+
+static __thread int my_node = -1;
+
+/* replica[n][f] is node n's copy of field[f] */
+static Real3Vect ***replica[MAXNODE][MAXFIELD];
+
+
+/* the node a cpu belongs to, from sysfs; 0 if it doesn't say */
+static int cpu_node(int cpu)
+{
+  char path[128];
+  int n;
+
+  if (cpu < 0)
+    return 0;
+
+  for (n=0; n<MAXNODE; n++) {
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/node%d", cpu, n);
+    if (access(path, F_OK) == 0)
+      return n;
+  }
+
+  return 0;
+}
+
+
+static int this_node(void)
+{
+  if (my_node < 0)
+    my_node = cpu_node(sched_getcpu());
+
+  return my_node;
+}
+
+
+void ***calloc_3d_array_numa(size_t nt, size_t nr, size_t nc, size_t size)
+{
+  void ***array;
+  void *data;
+  size_t i, j, plane;
+  long k;
+
+  plane = nr*nc*size;
+  if (posix_memalign(&data, huge_pages ? HUGE_ALIGN : 4096, nt*plane) != 0)
+    ath_error("[calloc_3d_array_numa]: failed to allocate %d x %d x %d of size %d\n",
+              (int)nt, (int)nr, (int)nc, (int)size);
+#ifdef MADV_HUGEPAGE
+  if (huge_pages)
+    madvise(data, nt*plane, MADV_HUGEPAGE);
+#endif
+
+  /* first touch: each thread zeroes a share of the planes, which puts
+     them in its node */
+#pragma omp parallel for schedule(static)
+  for (k=0; k<(long) nt; k++)
+    memset((unsigned char*) data + k*plane, 0, plane);
+
+  /* the same pointer tables as calloc_3d_array(), so free_3d_array()
+     frees this too */
+  array = (void***) calloc_1d_array(nt, sizeof(void**));
+  array[0] = (void**) calloc_1d_array(nt*nr, sizeof(void*));
+  for (i=0; i<nt; i++) {
+    array[i] = array[0] + i*nr;
+    for (j=0; j<nr; j++)
+      array[i][j] = (unsigned char*) data + i*plane + j*nc*size;
+  }
+
+  return array;
+}
+
+
+void numa_replicate(void)
+{
+  int seen[MAXNODE], nnode, n, f;
+  size_t bytes;
+
+  numa_free();
+  if (!numa_replicas || nfield == 0)
+    return;
+
+  /* which nodes are the threads on? */
+  memset(seen, 0, sizeof(seen));
+#pragma omp parallel
+  {
+    int node = this_node();
+#pragma omp critical (numa)
+    seen[node] = 1;
+  }
+  for (n=0, nnode=0; n<MAXNODE; n++)
+    nnode += seen[n];
+  if (nnode < 2) {
+    printf("numa: threads are on one node; not replicating the field\n");
+    return;
+  }
+
+  /* the first thread to arrive from each node copies the fields there.
+     (a parallel region inside this one has a single thread, so the
+     copy is first touched on this node.) */
+  bytes = (size_t) Nz*Ny*Nx*sizeof(Real3Vect);
+#pragma omp parallel private(f)
+  {
+    int node = this_node(), mine = 0;
+
+#pragma omp critical (numa)
+    {
+      if (seen[node] == 1) {
+        seen[node] = 2;
+        mine = 1;
+      }
+    }
+
+    for (f=0; mine && f<nfield; f++) {
+      replica[node][f] = (Real3Vect***)
+        calloc_3d_array_numa(Nz, Ny, Nx, sizeof(Real3Vect));
+      memcpy(replica[node][f][0][0], field[f][0][0], bytes);
+    }
+  }
+
+  numa_gen++;
+  printf("numa: %d copies of %d field(s), %.1f MB each\n", nnode, nfield,
+         bytes/1048576.0);
+
+  return;
+}
+
+
+void numa_free(void)
+{
+  int n, f;
+
+  for (n=0; n<MAXNODE; n++) {
+    for (f=0; f<MAXFIELD; f++) {
+      if (replica[n][f] != NULL)
+        free_3d_array((void***) replica[n][f]);
+      replica[n][f] = NULL;
+    }
+  }
+  numa_gen++;
+
+  return;
+}
+
+
+Real3Vect ***numa_lookup(Real3Vect ***b)
+{
+  int f, node;
+
+  numa_from = numa_copy = b;
+  numa_seen = numa_gen;
+
+  node = this_node();
+  for (f=0; f<nfield; f++)
+    if (field[f] == b && replica[node][f] != NULL)
+      numa_copy = replica[node][f];
+
+  return numa_copy;
+}
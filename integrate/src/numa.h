@@ -0,0 +1,50 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+
+/* where the field lives, on machines with more than one memory node.
+
+   the lines look B up all over the box, from every thread.  an array
+   which one thread zeroed (as calloc does) sits in that thread's
+   node, so every other socket reads it remotely, and through 4 kB
+   pages the lookups miss the TLB all the time.  so the big arrays
+   come from calloc_3d_array_numa() instead: aligned for huge pages,
+   with transparent huge pages asked for if huge_pages is set, and
+   zeroed plane by plane by all the threads, so the planes are spread
+   over the nodes the threads run on.
+
+   with numa_replicas set, numa_replicate() goes further and gives
+   each node its own read-only copy of every field, made by a thread
+   on that node.  interpolate_B() then reads the copy of B for the
+   node its thread is on (found once per thread, so threads should be
+   pinned: OMP_PROC_BIND=true).  this costs a copy of the fields per
+   node, and only happens when the threads are on more than one. */
+extern int huge_pages;
+extern int numa_replicas;
+
+void ***calloc_3d_array_numa(size_t nt, size_t nr, size_t nc, size_t size);
+
+/* after the fields are normalized, and before they are traced */
+void numa_replicate(void);
+void numa_free(void);
+
+/* the copy of b (one of field[]) for this thread's node; b itself if
+   there isn't one.  the last answer is kept per thread, and dropped
+   whenever the copies change. */
+extern __thread Real3Vect ***numa_from, ***numa_copy;
+extern __thread int numa_seen;
+extern int numa_gen;
+Real3Vect ***numa_lookup(Real3Vect ***b);
+
+#define NUMA_LOCAL(b) (((b) == numa_from && numa_seen == numa_gen) ? \
+                       numa_copy : numa_lookup(b))
+
+#endif
@@ -9,6 +9,10 @@
 
 #include "ath_error.h"
 
+#ifdef MPI_PARALLEL
+#include <mpi.h>
+#endif
+
 void   par_open(char *filename);
 void   par_cmdline(int argc, char *argv[]);
 int    par_exist(char *block, char *name);
@@ -28,4 +32,8 @@ void   par_setd(char *block, char *name, char *fmt, double dval, char *comment);
 void   par_dump(int mode, FILE *fp);
 void   par_close(void);
 
+#ifdef MPI_PARALLEL
+void   par_dist_mpi(const int mytid, MPI_Comm comm);
+#endif
+
 #endif
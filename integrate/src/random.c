@@ -1,4 +1,5 @@
 #include "random.h"
+#include "defs.h"
 
 inline double RandomReal()
 /* Returns a uniformly distributed random number in the interval [0,1].       */
@@ -33,3 +34,125 @@ double RandomNormal(double mu, double sigma)
 
   return (mu + y1 * sigma);
 }
+
+
+/* Philox4x32-10: ten rounds of a multiply-and-xor bijection on a
+   128-bit counter, with a Weyl sequence for the round keys. */
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+/* high and low halves of the 64-bit product a*b, in 16-bit pieces
+   since C89 has no 64-bit integer type */
+static void mulhilo32(rng_u32 a, rng_u32 b, rng_u32 *hi, rng_u32 *lo)
+{
+  rng_u32 al = a & 0xffffU, ah = a >> 16;
+  rng_u32 bl = b & 0xffffU, bh = b >> 16;
+  rng_u32 t, m1, m2;
+
+  t  = al*bl;
+  m1 = ah*bl + (t >> 16);
+  m2 = al*bh + (m1 & 0xffffU);
+
+  *hi = ah*bh + (m1 >> 16) + (m2 >> 16);
+  *lo = a*b;
+
+  return;
+}
+
+void philox4x32(const rng_u32 ctr[4], const rng_u32 key[2], rng_u32 out[4])
+{
+  rng_u32 x0 = ctr[0], x1 = ctr[1], x2 = ctr[2], x3 = ctr[3];
+  rng_u32 k0 = key[0], k1 = key[1];
+  rng_u32 hi0, lo0, hi1, lo1;
+  int r;
+
+  for (r=0; r<10; r++) {
+    mulhilo32(PHILOX_M0, x0, &hi0, &lo0);
+    mulhilo32(PHILOX_M1, x2, &hi1, &lo1);
+
+    x0 = hi1 ^ x1 ^ k0;
+    x2 = hi0 ^ x3 ^ k1;
+    x1 = lo1;
+    x3 = lo0;
+
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+
+  out[0] = x0;  out[1] = x1;  out[2] = x2;  out[3] = x3;
+
+  return;
+}
+
+
+/* map 32 random bits to (0,1), never 0 so it's safe to take the log */
+static double u32_to_real(rng_u32 x)
+{
+  return (x + 0.5) * (1.0/4294967296.0);
+}
+
+
+void random_uniform4(unsigned long seed, int stream, int a, int b,
+                     double out[4])
+{
+  rng_u32 ctr[4], key[2], bits[4];
+  int i;
+
+  key[0] = (rng_u32) seed;
+  key[1] = (rng_u32) (seed >> 16 >> 16);
+
+  ctr[0] = (rng_u32) b;
+  ctr[1] = (rng_u32) a;
+  ctr[2] = (rng_u32) stream;
+  ctr[3] = 0;
+
+  philox4x32(ctr, key, bits);
+
+  for (i=0; i<4; i++)
+    out[i] = u32_to_real(bits[i]);
+
+  return;
+}
+
+
+/* done in two flat passes -- all the random bits, then Box-Muller on
+   the whole chunk -- so that each loop is simple enough for the
+   compiler to vectorize. */
+#define NORMAL_CHUNK 256
+
+void random_normal_block(unsigned long seed, int stream, int line, int count,
+                         double mu, double sigma, double *out)
+{
+  rng_u32 ctr[4], key[2], bits[4*NORMAL_CHUNK];
+  double r, th;
+  int i, j, start, nblk;
+
+  key[0] = (rng_u32) seed;
+  key[1] = (rng_u32) (seed >> 16 >> 16);
+
+  ctr[1] = (rng_u32) line;
+  ctr[2] = (rng_u32) stream;
+  ctr[3] = 0;
+
+  for (start=0; start<count; start += NORMAL_CHUNK) {
+    nblk = MIN(NORMAL_CHUNK, count - start);
+
+    for (j=0; j<nblk; j++) {
+      ctr[0] = (rng_u32) (start + j);
+      philox4x32(ctr, key, &bits[4*j]);
+    }
+
+    /* pairs of uniforms -> pairs of normals */
+    for (i=0; i<4*nblk; i+=2) {
+      r  = sqrt(-2.0 * log(u32_to_real(bits[i])));
+      th = 2.0*PI * u32_to_real(bits[i+1]);
+
+      out[4*start+i]   = mu + sigma * r * cos(th);
+      out[4*start+i+1] = mu + sigma * r * sin(th);
+    }
+  }
+
+  return;
+}
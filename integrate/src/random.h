@@ -7,4 +7,29 @@
 inline double RandomReal();
 double RandomNormal(double mu, double sigma);
 
+/* counter-based generator (Philox4x32-10; Salmon et al. 2011).  the
+   output is a pure function of a 64-bit key and a 128-bit counter,
+   so there is no state to share between threads, and any number can
+   be regenerated on any thread or node.
+
+   flines keys the generator with the run's seed and puts the purpose
+   of the numbers (a RNG_* stream), the line, and the bundle member or
+   seed point in the counter. */
+enum { RNG_SEED, RNG_BUNDLE };
+
+typedef unsigned int rng_u32;
+
+void philox4x32(const rng_u32 ctr[4], const rng_u32 key[2], rng_u32 out[4]);
+
+/* four uniform deviates in (0,1) for counter (stream, a, b) */
+void random_uniform4(unsigned long seed, int stream, int a, int b,
+                     double out[4]);
+
+/* 4*count normal deviates with mean mu and standard deviation sigma.
+   out[4*i] to out[4*i+3] come from counter (stream, line, i), e.g.
+   bundle member i, so they don't depend on count or on which thread
+   asks. */
+void random_normal_block(unsigned long seed, int stream, int line, int count,
+                         double mu, double sigma, double *out);
+
 #endif
@@ -1,155 +1,472 @@
 #include "rk4.h"
 
+/* the grid, as the interpolation kernels need it: set by RK4_init() */
+static struct {
+  int imax, jmax, klo, kmax;    /* largest cell with a neighbour above */
+  double sx, sy, sz;            /* gradients in units of dx */
+} grid;
+
+
+/* interpolation kernels.  both clamp to the last cell with
+   neighbours, so points a little outside the box still get a value. */
+
+/* each component of B is linear along its own axis, between the
+   faces of the cell it lives on */
+static void interp_linear(Real3Vect *pos, Real3Vect *val)
+{
+  Real3Vect grad, dr;
+  Real3Vect ***b = NUMA_LOCAL(B);   /* this node's copy of B */
+
+  int i, j, k;
+  i = floor(pos->x1);
+  j = floor(pos->x2);
+  k = floor(pos->x3);
+
+  i = MIN(i, grid.imax); i = MAX(i, 0);
+  j = MIN(j, grid.jmax); j = MAX(j, 0);
+  k = MIN(k, grid.kmax); k = MAX(k, grid.klo);
+
+  dr.x1 = pos->x1 - i;
+  dr.x2 = pos->x2 - j;
+  dr.x3 = pos->x3 - k;
+
+  grad.x1 = b[k  ][j  ][i+1].x1 - b[k][j][i].x1;
+  grad.x2 = b[k  ][j+1][i  ].x2 - b[k][j][i].x2;
+  grad.x3 = b[k+1][j  ][i  ].x3 - b[k][j][i].x3;
+
+  grad.x1 *= grid.sx;
+  grad.x2 *= grid.sy;
+  grad.x3 *= grid.sz;
+
+  val->x1 = b[k][j][i].x1 + grad.x1 * dr.x1;
+  val->x2 = b[k][j][i].x2 + grad.x2 * dr.x2;
+  val->x3 = b[k][j][i].x3 + grad.x3 * dr.x3;
+
+  return;
+}
+
+
+/* every component trilinear between the 8 corners around pos.
+   smoother across cell edges, and twice the memory traffic. */
+static void interp_trilinear(Real3Vect *pos, Real3Vect *val)
+{
+  Real3Vect ***b = NUMA_LOCAL(B);
+  Real3Vect *c;
+  double fx, fy, fz, w;
+  int i, j, k, n;
+
+  i = floor(pos->x1);
+  j = floor(pos->x2);
+  k = floor(pos->x3);
+
+  i = MIN(i, grid.imax); i = MAX(i, 0);
+  j = MIN(j, grid.jmax); j = MAX(j, 0);
+  k = MIN(k, grid.kmax); k = MAX(k, grid.klo);
+
+  fx = pos->x1 - i;
+  fy = pos->x2 - j;
+  fz = pos->x3 - k;
+
+  val->x1 = val->x2 = val->x3 = 0.0;
+  for (n=0; n<8; n++) {
+    c = &b[k + (n>>2)][j + ((n>>1)&1)][i + (n&1)];
+    w = ((n&1)      ? fx : 1.0-fx) *
+        (((n>>1)&1) ? fy : 1.0-fy) *
+        ((n>>2)     ? fz : 1.0-fz);
+    val->x1 += w*c->x1;
+    val->x2 += w*c->x2;
+    val->x3 += w*c->x3;
+  }
+
+  return;
+}
+
+
+/* J[c][d] = dB_c/dx_d at pos, in cell units, for the variational
+   equations (see RK4State.growth).  this is the trilinear field's
+   whichever kernel is in use: inside a cell the linear kernel makes
+   each component depend on its own coordinate only, and all of the
+   shear that pulls neighbouring lines apart is in the jumps at the
+   cell faces, which a derivative can't see. */
+static void jacobian(Real3Vect *pos, double J[3][3])
+{
+  Real3Vect ***b = NUMA_LOCAL(B);
+  Real3Vect *c;
+  double f[3], w[3];
+  int i, j, k, n, d;
+
+  i = floor(pos->x1);
+  j = floor(pos->x2);
+  k = floor(pos->x3);
+
+  i = MIN(i, grid.imax); i = MAX(i, 0);
+  j = MIN(j, grid.jmax); j = MAX(j, 0);
+  k = MIN(k, grid.kmax); k = MAX(k, grid.klo);
+
+  f[0] = pos->x1 - i;
+  f[1] = pos->x2 - j;
+  f[2] = pos->x3 - k;
+
+  memset(J, 0, 9*sizeof(double));
+  for (n=0; n<8; n++) {
+    c = &b[k + (n>>2)][j + ((n>>1)&1)][i + (n&1)];
+    for (d=0; d<3; d++)
+      w[d] = ((n>>d)&1) ? f[d] : 1.0-f[d];
+
+    /* d/df of the weight is +-1 in place of its own factor */
+    for (d=0; d<3; d++) {
+      double dw = (((n>>d)&1) ? 1.0 : -1.0) * w[(d+1)%3] * w[(d+2)%3];
+      J[0][d] += dw*c->x1;
+      J[1][d] += dw*c->x2;
+      J[2][d] += dw*c->x3;
+    }
+  }
+
+  return;
+}
+
+
+/* the integrators, one per tableau, kernel and direction (see
+   rk4_kernel.h) */
+#define RK_CLASSIC 0
+#define RK_38      1
+
+#define KNAME rk4_linear_fwd
+#define KDIR  1
+#define KTAB  RK_CLASSIC
+#define KINTERP interp_linear
+#include "rk4_kernel.h"
+
+#define KNAME rk4_linear_bwd
+#define KDIR  -1
+#define KTAB  RK_CLASSIC
+#define KINTERP interp_linear
+#include "rk4_kernel.h"
+
+#define KNAME rk4_trilinear_fwd
+#define KDIR  1
+#define KTAB  RK_CLASSIC
+#define KINTERP interp_trilinear
+#include "rk4_kernel.h"
+
+#define KNAME rk4_trilinear_bwd
+#define KDIR  -1
+#define KTAB  RK_CLASSIC
+#define KINTERP interp_trilinear
+#include "rk4_kernel.h"
+
+#define KNAME rk38_linear_fwd
+#define KDIR  1
+#define KTAB  RK_38
+#define KINTERP interp_linear
+#include "rk4_kernel.h"
+
+#define KNAME rk38_linear_bwd
+#define KDIR  -1
+#define KTAB  RK_38
+#define KINTERP interp_linear
+#include "rk4_kernel.h"
+
+#define KNAME rk38_trilinear_fwd
+#define KDIR  1
+#define KTAB  RK_38
+#define KINTERP interp_trilinear
+#include "rk4_kernel.h"
+
+#define KNAME rk38_trilinear_bwd
+#define KDIR  -1
+#define KTAB  RK_38
+#define KINTERP interp_trilinear
+#include "rk4_kernel.h"
+
+
+typedef void (*Interp)(Real3Vect *pos, Real3Vect *val);
+typedef void (*Step)(Real3Vect *xn, Real3Vect *xnp1, double h_mag);
+typedef void (*QcStep)(Real3Vect *xn, Real3Vect *xnp1,
+                       double h_try, double *h_did, double *h_next,
+                       double tolerance, Real3Vect *b_n);
+
+/* the dispatch table; [0] steps backward, [1] forward */
+#define VARIANT(tab, kern) \
+  {#tab, #kern, interp_##kern, \
+   {step_##tab##_##kern##_bwd, step_##tab##_##kern##_fwd}, \
+   {qc_step_##tab##_##kern##_bwd, qc_step_##tab##_##kern##_fwd}}
+
+static struct {
+  char *tableau, *kernel;
+  Interp interp;
+  Step step[2];
+  QcStep qc_step[2];
+} variants[] = {
+  VARIANT(rk4,  linear),
+  VARIANT(rk4,  trilinear),
+  VARIANT(rk38, linear),
+  VARIANT(rk38, trilinear)
+};
+#define NVARIANT ((int) (sizeof(variants)/sizeof(variants[0])))
+
+static int variant = -1;        /* the one in use */
+
+
+/* carry m = dx/dx_seed across the step of (signed) size h out of xn,
+   where B is b_n: classic RK4 on dm/dt = J(x(t)) m, with x(t) at the
+   stages retraced the same way whatever tableau the line itself
+   uses */
+static void tangent_step(Real3Vect *xn, Real3Vect *b_n, double h,
+                         double m[3][3])
+{
+  static const double a[4] = {0.0, 0.5, 0.5, 1.0};   /* stage offsets */
+  static const double w[4] = {1.0, 2.0, 2.0, 1.0};   /* and weights */
+  Real3Vect x, k;
+  double J[3][3], km[3][3], mt[3][3], dm[3][3];
+  int s, c, d, e;
+
+  k = *b_n;
+  memset(km, 0, sizeof(km));
+  memset(dm, 0, sizeof(dm));
+  for (s=0; s<4; s++) {
+    x.x1 = xn->x1 + a[s] * h * k.x1;
+    x.x2 = xn->x2 + a[s] * h * k.x2;
+    x.x3 = xn->x3 + a[s] * h * k.x3;
+    if (s > 0)
+      variants[variant].interp(&x, &k);
+    jacobian(&x, J);
+
+    for (c=0; c<3; c++)
+      for (d=0; d<3; d++)
+        mt[c][d] = m[c][d] + a[s] * h * km[c][d];
+    for (c=0; c<3; c++) {
+      for (d=0; d<3; d++) {
+        km[c][d] = 0.0;
+        for (e=0; e<3; e++)
+          km[c][d] += J[c][e] * mt[e][d];
+        dm[c][d] += w[s] * km[c][d];
+      }
+    }
+  }
+
+  for (c=0; c<3; c++)
+    for (d=0; d<3; d++)
+      m[c][d] += h * dm[c][d] / 6.0;
+
+  return;
+}
+
+
+static float frobenius(double m[3][3])
+{
+  double sum = 0.0;
+  int c, d;
+
+  for (c=0; c<3; c++)
+    for (d=0; d<3; d++)
+      sum += SQR(m[c][d]);
+
+  return sqrt(sum);
+}
+
 /* Integrate forward and backward along a field line until either
      a) you hit the edge of the box, or
      b) the loop closes, or
      c) you hit maxlen or maxsteps, or
-     d) you land in a region where B~0 */
-void RK4_integrate(Real3Vect *xvals)
+     d) you land in a region where B~0, or
+     e) you come within d_test of another line */
+void RK4_integrate(Real3Vect *xvals, float *bmag, float *growth,
+                   double d_test, int *stop)
 {
-  int i;
-  double h, h_did, h_next, h_try = 1.0;
-  double dr, maxdr, dl;
+  RK4State s;
+  double t0;
 
-  h = h_try;
   /* integrate forward... */
-  i = maxstep/2;
-  maxdr = dl = 0.0;
-  while (in_bounds(&xvals[i]) && i < maxstep-1)
-  {
-    RK4_qc_step(&xvals[i], &xvals[i+1], h, &h_did, &h_next, tolerance, 1);
+  t0 = trace_begin();
+  RK4_start(&s, xvals, 1);
+  s.bmag = bmag;
+  s.growth = growth;
+  RK4_advance(&s, xvals, d_test, NULL);
+  if (stop != NULL)
+    stop[0] = s.why;
+  trace_end("forward", t0, s.i - maxstep/2);
+
+  /* ... then integrate backward */
+  t0 = trace_begin();
+  RK4_start(&s, xvals, -1);
+  s.bmag = bmag;
+  s.growth = growth;
+  RK4_advance(&s, xvals, d_test, NULL);
+  if (stop != NULL)
+    stop[1] = s.why;
+  trace_end("backward", t0, maxstep/2 - s.i);
 
-    /* stop if we land in a region where B = 0... */
-    dr = dist(&xvals[i], &xvals[i+1]);
-    if (dr <= xeno)
-      break;
+  return;
+}
 
-    /* ...or it we hit maxlen... */
-    dl += dr;
-    if (dl >= maxlen)
-      break;
 
-    /* ...or if loop closes */
-    dr = dist(&xvals[maxstep/2], &xvals[i+1]);
-    maxdr = MAX(maxdr, dr);
-    if (maxdr > close_hi && dr <= close_lo)
-      break;
+void RK4_start(RK4State *s, Real3Vect *xvals, int dir)
+{
+  if (variant < 0)
+    ath_error("[RK4_start]: RK4_init() hasn't been called\n");
 
-    h = h_next;
-    i += 1;
-  }
-  if (i == maxstep-1)
-    printf("[line forward]: step limit reached.\n");
-
-  h = h_try;
-   /* ... then integrate backward */
-  i = maxstep/2;
-  maxdr = dl = 0.0;
-  while (in_bounds(&xvals[i]) && i > 0)
+  s->seed = xvals[maxstep/2];
+  s->prev = xvals[maxstep/2+1];
+  s->x    = xvals[maxstep/2];
+
+  s->h  = 1.0;
+  s->dl = s->maxdr = 0.0;
+
+  s->i = s->last = maxstep/2;
+  s->dir = dir;
+  s->why = STOP_BOUNDARY;
+  s->bmag = NULL;
+  s->growth = NULL;
+  memset(s->m, 0, sizeof(s->m));
+  s->m[0][0] = s->m[1][1] = s->m[2][2] = 1.0;
+
+  return;
+}
+
+
+int RK4_advance(RK4State *s, Real3Vect *xvals, double d_test,
+                int (*inside)(Real3Vect *x))
+{
+  int i, dir, end;
+  double dr, h_did, h_next;
+  Real3Vect b;
+  QcStep qc_step;
+
+  i = s->i;
+  dir = s->dir;
+  end = (dir > 0) ? maxstep-1 : 0;
+  qc_step = variants[variant].qc_step[dir > 0];
+
+  xvals[i] = s->x;
+  if (s->growth != NULL)
+    s->growth[i] = frobenius(s->m);
+  while (in_bounds(&xvals[i]) && i != end)
   {
-    RK4_qc_step(&xvals[i], &xvals[i-1], h, &h_did, &h_next, tolerance, -1);
+    /* hand the line over to whoever owns this part of the box */
+    if (inside != NULL && !inside(&xvals[i])) {
+      s->i = i;
+      s->x = xvals[i];
+      return 1;
+    }
 
-    /* stop if we land in a region where B = 0... */
-    dr = dist(&xvals[i], &xvals[i-1]);
-    if (sqrt(dr) <= xeno)
+    qc_step(&xvals[i], &xvals[i+dir], s->h, &h_did, &h_next, tolerance,
+            (s->bmag != NULL || s->growth != NULL) ? &b : NULL);
+    s->last = i+dir;
+    if (s->bmag != NULL)
+      s->bmag[i] = sqrt(SQR(b.x1) + SQR(b.x2) + SQR(b.x3));
+    if (s->growth != NULL) {
+      tangent_step(&xvals[i], &b, h_did*dir, s->m);
+      s->growth[i+dir] = frobenius(s->m);
+    }
+
+    /* stop if we land in a region where B = 0... (going backward,
+       this has always compared sqrt(dr); kept so lines don't change) */
+    dr = dist(&xvals[i], &xvals[i+dir]);
+    if ((dir > 0 ? dr : sqrt(dr)) <= xeno) {
+      s->why = STOP_XENO;
       break;
+    }
+
+    /* ...or into a dead region around a null, where it would only
+       creep along until it did... */
+    if (null_dead(&xvals[i+dir])) {
+      s->why = STOP_NULL;
+      break;
+    }
 
     /* ...or it we hit maxlen... */
-    dl += dr;
-    if (dl >= maxlen)
+    s->dl += dr;
+    if (s->dl >= maxlen) {
+      s->why = STOP_MAXLEN;
+      break;
+    }
+
+    /* ...or if loop closes.  going backward, this tests the point
+       before the step rather than after it. */
+    dr = dist(&s->seed, (dir > 0) ? &xvals[i+1] : &s->prev);
+    s->maxdr = MAX(s->maxdr, dr);
+    if (s->maxdr > close_hi && dr <= close_lo) {
+      s->why = STOP_CLOSED;
       break;
+    }
 
-    /* ...or if loop closes */
-    dr = dist(&xvals[maxstep/2], &xvals[i+1]);
-    maxdr = MAX(maxdr, dr);
-    if (maxdr > close_hi && dr <= close_lo)
+    /* ...or if we run into a neighbouring line */
+    if (d_test > 0.0 && sep_near(&xvals[i+dir], d_test)) {
+      s->why = STOP_NEIGHBOUR;
       break;
+    }
+
+    s->h = h_next;
+    s->prev = xvals[i];
+    i += dir;
+  }
+  if (i == end) {
+    s->why = STOP_STEPLIMIT;
+    printf("[line %s]: step limit reached.\n", (dir > 0) ? "forward" : "backward");
+  }
 
-    h = h_next;
-    i -= 1;
+  s->i = i;
+  s->x = xvals[i];
+
+  /* nothing steps out of the last point, so look its |B| up */
+  if (s->bmag != NULL) {
+    interpolate_B(&xvals[s->last], &b);
+    s->bmag[s->last] = sqrt(SQR(b.x1) + SQR(b.x2) + SQR(b.x3));
   }
-  if (i == 0)
-    printf("[line backward]: step limit reached.\n");
 
-  return;
+  return 0;
 }
 
 
-/* RK4 step with adaptive step size.  Adjusts the step size to reach
-   an approximate error equal to `tolerance'. */
-void RK4_qc_step(Real3Vect *xn, Real3Vect *xnp1,
-                 double h_try, double *h_did, double *h_next,
-                 double tolerance, int dir)
+void RK4_init(char *tableau, char *kernel)
 {
-  double h, err;
-  Real3Vect x_coarse;
-  int i;
-
-  h = h_try;
-  i = 0;
-  while (1==1){
-    /* take two half-steps.  save in xnp1; use x_coarse as a scratch buffer */
-    RK4_step(xn,        &x_coarse, 0.5*h, dir);
-    RK4_step(&x_coarse, xnp1,      0.5*h, dir);
-
-    /* take a full step.  save in x_coarse */
-    RK4_step(xn, &x_coarse, h, dir);
-
-    /* estimate the error */
-    err = dist(&x_coarse, xnp1) / tolerance;
-    err = MAX(fabs(err), TINY_NUMBER);
-
-    /* if the error is small enough, increase the next time-step and exit... */
-    if (err <= 1.0) {
-      *h_did = h;
-      *h_next = 0.9*exp(-0.20*log(err)) * h; /* err ~ h^5 */
-      *h_next = MIN(*h_next, 4.0*h); /* limit growth to a factor of 4 */
+  int v;
 
+  for (v=0; v<NVARIANT; v++)
+    if (strcmp(variants[v].tableau, tableau) == 0 &&
+        strcmp(variants[v].kernel, kernel) == 0)
       break;
-    } else if (i > 15) {
-      *h_did = h;
-      *h_next = h_try;
-      printf("hit %d iterations, h hit %f.  giving up.\n", i, h);
-
-      break;
-    }
-
-    i+=1;
-
-    /* ...otherwise, shrink time step and try again. */
-    h = 0.9 * exp(-0.25*log(err)) * h; /* err ~ h^4 */
-  }
+  if (v == NVARIANT)
+    ath_error("[RK4_init]: no integrator for tableau = %s, interpolation = %s\n",
+              tableau, kernel);
+  variant = v;
+
+  grid.imax = Nx-2;
+  grid.jmax = Ny-2;
+  grid.klo  = Klo;
+  grid.kmax = Khi-2;
+  grid.sx = dx/dx;
+  grid.sy = dx/dy;
+  grid.sz = dx/dz;
 
   return;
 }
 
 
-/* Single RK4 step with a fixed step size. */
-void RK4_step(Real3Vect *xn, Real3Vect *xnp1, double h_mag, int dir)
+int RK4_variant(void)
 {
-  Real3Vect xtmp, k1, k2, k3, k4;
-  double h = h_mag*dir; /* dir = +1 or -1 */
+  return variant;
+}
 
-  interpolate_B(xn, &k1);
 
-  xtmp.x1 = xn->x1 + 0.5 * h * k1.x1;
-  xtmp.x2 = xn->x2 + 0.5 * h * k1.x2;
-  xtmp.x3 = xn->x3 + 0.5 * h * k1.x3;
-  interpolate_B(&xtmp, &k2);
+/* RK4 step with adaptive step size.  Adjusts the step size to reach
+   an approximate error equal to `tolerance'. */
+void RK4_qc_step(Real3Vect *xn, Real3Vect *xnp1,
+                 double h_try, double *h_did, double *h_next,
+                 double tolerance, int dir, Real3Vect *b_n)
+{
+  variants[variant].qc_step[dir > 0](xn, xnp1, h_try, h_did, h_next,
+                                     tolerance, b_n);
 
-  xtmp.x1 = xn->x1 + 0.5 * h * k2.x1;
-  xtmp.x2 = xn->x2 + 0.5 * h * k2.x2;
-  xtmp.x3 = xn->x3 + 0.5 * h * k2.x3;
-  interpolate_B(&xtmp, &k3);
+  return;
+}
 
-  xtmp.x1 = xn->x1 + h * k3.x1;
-  xtmp.x2 = xn->x2 + h * k3.x2;
-  xtmp.x3 = xn->x3 + h * k3.x3;
-  interpolate_B(&xtmp, &k4);
 
-  xnp1->x1 = xn->x1 + h * (k1.x1 + 2.0*k2.x1 + 2.0*k3.x1 + k4.x1)/6.0;
-  xnp1->x2 = xn->x2 + h * (k1.x2 + 2.0*k2.x2 + 2.0*k3.x2 + k4.x2)/6.0;
-  xnp1->x3 = xn->x3 + h * (k1.x3 + 2.0*k2.x3 + 2.0*k3.x3 + k4.x3)/6.0;
+/* Single RK4 step with a fixed step size. */
+void RK4_step(Real3Vect *xn, Real3Vect *xnp1, double h_mag, int dir)
+{
+  variants[variant].step[dir > 0](xn, xnp1, h_mag);
 
   return;
 }
@@ -164,35 +481,10 @@ inline double dist (Real3Vect *p1, Real3Vect *p2)
 }
 
 
-/* Linear interpolation between grid points. */
+/* interpolation between grid points, with the kernel in use */
 void interpolate_B(Real3Vect *pos, Real3Vect *val)
 {
-  Real3Vect grad, dr;
-
-  int i, j, k;
-  i = floor(pos->x1);
-  j = floor(pos->x2);
-  k = floor(pos->x3);
-
-  i = MIN(i, Nx-2);  i = MAX(i, 0);
-  j = MIN(j, Ny-2);  j = MAX(j, 0);
-  k = MIN(k, Nz-2);  k = MAX(k, 0);
-
-  dr.x1 = pos->x1 - i;
-  dr.x2 = pos->x2 - j;
-  dr.x3 = pos->x3 - k;
-
-  grad.x1 = B[k  ][j  ][i+1].x1 - B[k][j][i].x1;
-  grad.x2 = B[k  ][j+1][i  ].x2 - B[k][j][i].x2;
-  grad.x3 = B[k+1][j  ][i  ].x3 - B[k][j][i].x3;
-
-  grad.x1 *= (dx/dx);
-  grad.x2 *= (dx/dy);
-  grad.x3 *= (dx/dz);
-
-  val->x1 = B[k][j][i].x1 + grad.x1 * dr.x1;
-  val->x2 = B[k][j][i].x2 + grad.x2 * dr.x2;
-  val->x3 = B[k][j][i].x3 + grad.x3 * dr.x3;
+  variants[variant].interp(pos, val);
 
   return;
 }
@@ -200,7 +492,7 @@ void interpolate_B(Real3Vect *pos, Real3Vect *val)
 
 inline int in_bounds(Real3Vect *x)
 {
-  return (x->x1 > 0 && x->x1 < Nx-1 &&
-          x->x2 > 0 && x->x2 < Ny-1 &&
-          x->x3 > 0 && x->x3 < Nz-1);
+  return (x->x1 > roi_lo[0] && x->x1 < roi_hi[0] &&
+          x->x2 > roi_lo[1] && x->x2 < roi_hi[1] &&
+          x->x3 > roi_lo[2] && x->x3 < roi_hi[2]);
 }
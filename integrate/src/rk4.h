@@ -7,14 +7,20 @@
 #include "ath_array.h"
 #include "ath_error.h"
 #include "ath_vtk.h"
+#include "sep.h"
+#include "stats.h"
+#include "trace.h"
+#include "numa.h"
+#include "nulls.h"
 
 /* variables defined in vtk.c */
 extern int Nx, Ny, Nz;          /* size of grid in cell units */
 extern double dx, dy, dz;       /* cell sizes in physical units */
 extern Real3Vect ***B;          /* magnetic field */
+extern int Klo, Khi;            /* planes of B in memory */
 
 
-/* variables defined in main.c (read from par file) */
+/* variables defined in lines.c (read from par file in main.c) */
 extern int maxstep;             /* max # of steps to integrate */
 extern double maxlen;           /* max length of the field line */
 extern double tolerance;        /* accuracy goal for RK4 step.
@@ -28,22 +34,88 @@ extern double close_hi;
 
 
 
+/* choose the integrator, once the grid is read: tableau is "rk4"
+   (the classic one) or "rk38" (Kutta's 3/8 rule), and kernel is
+   "linear" (each component along its own axis) or "trilinear" (all
+   8 corners).  each combination is compiled separately for each
+   direction, with the grid constants it needs taken here (see
+   rk4_kernel.h), so this must be called again if the grid changes.
+   nothing below works until it is called. */
+void RK4_init(char *tableau, char *kernel);
+
+/* which of them is in use, as a number that stays the same from run
+   to run */
+int RK4_variant(void);
+
 /* Integrate forward and backward along a field line until either
      a) you hit the edge of the box, or
      b) the loop closes, or
      c) you hit maxlen or maxsteps, or
-     d) you land in a region where B~0 */
-void RK4_integrate(Real3Vect *xvals);
+     d) you land in a region where B~0, or
+     e) you come within d_test of another line (see sep.h).  pass
+        d_test <= 0 to skip this check, or
+     f) you step into a dead region around a null (see nulls.h).
+   if stop is not NULL, the reasons for stopping going forward and
+   backward (STOP_* in stats.h) are stored in stop[0] and stop[1].
+   if bmag is not NULL, bmag[i] gets |B| at xvals[i], taken from the
+   first stage of the step out of that point.  if growth is not NULL,
+   it gets RK4State.growth. */
+void RK4_integrate(Real3Vect *xvals, float *bmag, float *growth,
+                   double d_test, int *stop);
+
+/* the state of one direction of one line, so that its integration
+   can stop and pick up again later (possibly on another MPI rank; see
+   domain.h).  RK4_integrate() is RK4_start() and RK4_advance() run to
+   the end in each direction. */
+typedef struct RK4State_s{
+  Real3Vect x;                  /* current point, xvals[i] */
+  Real3Vect seed;               /* xvals[maxstep/2], for closure */
+  Real3Vect prev;               /* xvals[i+1], for closure going backward */
+  double h;                     /* step size to try next */
+  double dl;                    /* length so far */
+  double maxdr;                 /* furthest distance from the seed */
+  int i;                        /* index of the current point */
+  int last;                     /* index of the last point written */
+  int dir;                      /* +1 forward, -1 backward */
+  int why;                      /* STOP_* reason, once it stops */
+  float *bmag;                  /* |B| at each point, if not NULL.  only
+                                   means anything on this rank */
+  double m[3][3];               /* dx/dx_seed, the variational equations
+                                   integrated along with the line */
+  float *growth;                /* if not NULL, |m| (Frobenius) at each
+                                   point: the rms a small kick of each
+                                   coordinate of the seed has grown to,
+                                   per unit kick, as far as linear
+                                   theory goes.  this is what a bundle
+                                   of kicked lines measures, for about
+                                   the cost of one more line */
+}RK4State;
+
+/* start from xvals[maxstep/2] in direction dir.  going backward,
+   xvals[maxstep/2+1] must already hold the first forward point (or
+   whatever the line was initialized to, if there isn't one).  bmag
+   and growth start out NULL. */
+void RK4_start(RK4State *s, Real3Vect *xvals, int dir);
+
+/* step along the line, filling in xvals, until it stops for one of
+   the reasons above, or, if inside is not NULL, until the current
+   point is not inside(); then return 1 so that the line can be
+   resumed elsewhere.  xvals[s->i] is (re)set from s->x first. */
+int RK4_advance(RK4State *s, Real3Vect *xvals, double d_test,
+                int (*inside)(Real3Vect *x));
 
-/* Single RK4 step with adaptive step size and error control */
+/* Single RK4 step with adaptive step size and error control.  B at
+   xn is the same for every trial step, so it is looked up once; if
+   b_n is not NULL it gets a copy. */
 void RK4_qc_step(Real3Vect *xn, Real3Vect *xnp1,
                  double h_try, double *h_did, double *h_next,
-                 double tolerance, int dir);
+                 double tolerance, int dir, Real3Vect *b_n);
 
 /* Single RK4 step */
 void RK4_step(Real3Vect *xn, Real3Vect *xnp1, double hh, int dir);
 
-/* Linear interpolation between grid points. */
+/* interpolation between grid points, with the kernel chosen in
+   RK4_init() */
 void interpolate_B(Real3Vect *pos, Real3Vect *val);
 
 
@@ -0,0 +1,146 @@
+/* the integrator core, specialized at compile time.  this is a
+   template: rk4.c includes it once for every combination it
+   offers, after defining
+
+     KNAME    suffix for the names of the functions made here
+     KDIR     +1 to step forward along B, -1 backward
+     KTAB     the Butcher tableau: RK_CLASSIC or RK_38
+     KINTERP  the interpolation kernel, a static function like
+              interp_linear()
+
+   so that the direction, the coefficients and the kernel are all
+   constants the compiler can inline and fold, instead of arguments
+   and globals looked up on every stage.  the names it defines are
+   step_k1_KNAME(), step_KNAME() and qc_step_KNAME(). */
+
+#define KFN3(f, n) f##_##n
+#define KFN2(f, n) KFN3(f, n)
+#define KFN(f)     KFN2(f, KNAME)
+
+
+/* one step of size h_mag, given B at xn */
+static void KFN(step_k1)(Real3Vect *xn, Real3Vect *k1, Real3Vect *xnp1,
+                         double h_mag)
+{
+  Real3Vect xtmp, k2, k3, k4;
+  double h = h_mag*KDIR;
+
+#if KTAB == RK_CLASSIC
+  xtmp.x1 = xn->x1 + 0.5 * h * k1->x1;
+  xtmp.x2 = xn->x2 + 0.5 * h * k1->x2;
+  xtmp.x3 = xn->x3 + 0.5 * h * k1->x3;
+  KINTERP(&xtmp, &k2);
+
+  xtmp.x1 = xn->x1 + 0.5 * h * k2.x1;
+  xtmp.x2 = xn->x2 + 0.5 * h * k2.x2;
+  xtmp.x3 = xn->x3 + 0.5 * h * k2.x3;
+  KINTERP(&xtmp, &k3);
+
+  xtmp.x1 = xn->x1 + h * k3.x1;
+  xtmp.x2 = xn->x2 + h * k3.x2;
+  xtmp.x3 = xn->x3 + h * k3.x3;
+  KINTERP(&xtmp, &k4);
+
+  xnp1->x1 = xn->x1 + h * (k1->x1 + 2.0*k2.x1 + 2.0*k3.x1 + k4.x1)/6.0;
+  xnp1->x2 = xn->x2 + h * (k1->x2 + 2.0*k2.x2 + 2.0*k3.x2 + k4.x2)/6.0;
+  xnp1->x3 = xn->x3 + h * (k1->x3 + 2.0*k2.x3 + 2.0*k3.x3 + k4.x3)/6.0;
+#elif KTAB == RK_38
+  /* Kutta's 3/8 rule */
+  xtmp.x1 = xn->x1 + h * k1->x1/3.0;
+  xtmp.x2 = xn->x2 + h * k1->x2/3.0;
+  xtmp.x3 = xn->x3 + h * k1->x3/3.0;
+  KINTERP(&xtmp, &k2);
+
+  xtmp.x1 = xn->x1 + h * (k2.x1 - k1->x1/3.0);
+  xtmp.x2 = xn->x2 + h * (k2.x2 - k1->x2/3.0);
+  xtmp.x3 = xn->x3 + h * (k2.x3 - k1->x3/3.0);
+  KINTERP(&xtmp, &k3);
+
+  xtmp.x1 = xn->x1 + h * (k1->x1 - k2.x1 + k3.x1);
+  xtmp.x2 = xn->x2 + h * (k1->x2 - k2.x2 + k3.x2);
+  xtmp.x3 = xn->x3 + h * (k1->x3 - k2.x3 + k3.x3);
+  KINTERP(&xtmp, &k4);
+
+  xnp1->x1 = xn->x1 + h * (k1->x1 + 3.0*k2.x1 + 3.0*k3.x1 + k4.x1)/8.0;
+  xnp1->x2 = xn->x2 + h * (k1->x2 + 3.0*k2.x2 + 3.0*k3.x2 + k4.x2)/8.0;
+  xnp1->x3 = xn->x3 + h * (k1->x3 + 3.0*k2.x3 + 3.0*k3.x3 + k4.x3)/8.0;
+#else
+#error "rk4_kernel.h: unknown KTAB"
+#endif
+
+  return;
+}
+
+
+static void KFN(step)(Real3Vect *xn, Real3Vect *xnp1, double h_mag)
+{
+  Real3Vect k1;
+
+  KINTERP(xn, &k1);
+  KFN(step_k1)(xn, &k1, xnp1, h_mag);
+
+  return;
+}
+
+
+/* see RK4_qc_step() */
+static void KFN(qc_step)(Real3Vect *xn, Real3Vect *xnp1,
+                         double h_try, double *h_did, double *h_next,
+                         double tolerance, Real3Vect *b_n)
+{
+  double h, err;
+  Real3Vect x_coarse, k1;
+  int i;
+
+  /* the first stage of both steps out of xn, on every try */
+  KINTERP(xn, &k1);
+  if (b_n != NULL)
+    *b_n = k1;
+
+  h = h_try;
+  i = 0;
+  while (1==1){
+    /* take two half-steps.  save in xnp1; use x_coarse as a scratch buffer */
+    KFN(step_k1)(xn,     &k1, &x_coarse, 0.5*h);
+    KFN(step)(&x_coarse, xnp1,           0.5*h);
+
+    /* take a full step.  save in x_coarse */
+    KFN(step_k1)(xn, &k1, &x_coarse, h);
+
+    /* estimate the error */
+    err = dist(&x_coarse, xnp1) / tolerance;
+    err = MAX(fabs(err), TINY_NUMBER);
+
+    /* if the error is small enough, increase the next time-step and exit... */
+    if (err <= 1.0) {
+      *h_did = h;
+      *h_next = 0.9*exp(-0.20*log(err)) * h; /* err ~ h^5 */
+      *h_next = MIN(*h_next, 4.0*h); /* limit growth to a factor of 4 */
+
+      stats_step(h, i, 0);
+      break;
+    } else if (i > 15) {
+      *h_did = h;
+      *h_next = h_try;
+      printf("hit %d iterations, h hit %f.  giving up.\n", i, h);
+
+      stats_step(h, i, 1);
+      break;
+    }
+
+    i+=1;
+
+    /* ...otherwise, shrink time step and try again. */
+    h = 0.9 * exp(-0.25*log(err)) * h; /* err ~ h^4 */
+  }
+
+  return;
+}
+
+#undef KFN
+#undef KFN2
+#undef KFN3
+#undef KNAME
+#undef KDIR
+#undef KTAB
+#undef KINTERP
@@ -0,0 +1,167 @@
+#include "sep.h"
+
+static double sep_cell = 1.0;   /* side of a hash cube */
+
+static Real3Vect *pts = NULL;   /* stored points... */
+static int *next = NULL;        /* ...chained within each bucket */
+static int npts, maxpts;
+
+static int *head = NULL;        /* first point in each bucket */
+static int nbucket;
+
+static void sep_rehash(int n);
+
+
+static unsigned int hash_cube(int i, int j, int k)
+{
+  return ((unsigned int) i * 73856093u) ^
+         ((unsigned int) j * 19349663u) ^
+         ((unsigned int) k * 83492791u);
+}
+
+static unsigned int hash_point(Real3Vect *x)
+{
+  return hash_cube((int) floor(x->x1 / sep_cell),
+                   (int) floor(x->x2 / sep_cell),
+                   (int) floor(x->x3 / sep_cell));
+}
+
+
+void sep_init(double cell)
+{
+  if (cell <= 0.0)
+    ath_error("[sep_init]: cell size must be positive (got %f)\n", cell);
+
+  sep_cell = cell;
+
+  npts = 0;
+  maxpts = 1024;
+  pts  = (Real3Vect*) calloc_1d_array(maxpts, sizeof(Real3Vect));
+  next = (int*) calloc_1d_array(maxpts, sizeof(int));
+
+  sep_rehash(1024);
+
+  return;
+}
+
+
+void sep_free(void)
+{
+  if (pts != NULL)  free_1d_array((void*) pts);
+  if (next != NULL) free_1d_array((void*) next);
+  if (head != NULL) free_1d_array((void*) head);
+
+  pts = NULL;  next = NULL;  head = NULL;
+  npts = maxpts = nbucket = 0;
+
+  return;
+}
+
+
+/* rebuild the bucket heads with n (a power of 2) buckets */
+static void sep_rehash(int n)
+{
+  int i, b;
+
+  if (head != NULL) free_1d_array((void*) head);
+
+  nbucket = n;
+  head = (int*) calloc_1d_array(nbucket, sizeof(int));
+  for (b=0; b<nbucket; b++)
+    head[b] = -1;
+
+  for (i=0; i<npts; i++) {
+    b = hash_point(&pts[i]) & (nbucket-1);
+    next[i] = head[b];
+    head[b] = i;
+  }
+
+  return;
+}
+
+
+static void sep_add_point(Real3Vect *x)
+{
+  int b;
+
+  if (npts == maxpts) {
+    maxpts *= 2;
+    pts  = (Real3Vect*) realloc(pts, maxpts * sizeof(Real3Vect));
+    next = (int*) realloc(next, maxpts * sizeof(int));
+    if (pts == NULL || next == NULL)
+      ath_error("[sep_add_point]: failed to grow to %d points\n", maxpts);
+  }
+
+  pts[npts] = *x;
+
+  b = hash_point(x) & (nbucket-1);
+  next[npts] = head[b];
+  head[b] = npts;
+
+  npts++;
+
+  if (npts > 2*nbucket)
+    sep_rehash(2*nbucket);
+
+  return;
+}
+
+
+/* only keep points spaced by a quarter of a cube; that's plenty to
+   resolve distances of order sep_cell */
+void sep_add_line(Real3Vect *xvals, int n)
+{
+  int j;
+  Real3Vect last;
+
+  last.x1 = last.x2 = last.x3 = -HUGE_NUMBER;
+
+  for (j=0; j<n; j++) {
+    if (xvals[j].x1 > 0.0 && xvals[j].x2 > 0.0 && xvals[j].x3 > 0.0) {
+      if (SQR(xvals[j].x1 - last.x1) +
+          SQR(xvals[j].x2 - last.x2) +
+          SQR(xvals[j].x3 - last.x3) >= SQR(0.25*sep_cell)) {
+        sep_add_point(&xvals[j]);
+        last = xvals[j];
+      }
+    }
+  }
+
+  return;
+}
+
+
+int sep_near(Real3Vect *x, double d)
+{
+  int i, j, k, di, dj, dk, p, r;
+  double d2 = SQR(d);
+
+  if (npts == 0)
+    return 0;
+
+  i = (int) floor(x->x1 / sep_cell);
+  j = (int) floor(x->x2 / sep_cell);
+  k = (int) floor(x->x3 / sep_cell);
+
+  r = (int) ceil(d / sep_cell);
+
+  for (dk=-r; dk<=r; dk++) {
+    for (dj=-r; dj<=r; dj++) {
+      for (di=-r; di<=r; di++) {
+        p = head[hash_cube(i+di, j+dj, k+dk) & (nbucket-1)];
+
+        /* other cubes can share this bucket; the distance test
+           doesn't care */
+        while (p >= 0) {
+          if (SQR(pts[p].x1 - x->x1) +
+              SQR(pts[p].x2 - x->x2) +
+              SQR(pts[p].x3 - x->x3) < d2)
+            return 1;
+          p = next[p];
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef SEP_H
+#define SEP_H
+
+#include <math.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+
+/* spatial hash over the points of lines which have already been
+   traced.  used for evenly spaced seeding: a candidate seed is
+   rejected if it falls within d_sep of an existing line, and a new
+   line is stopped once it comes within d_test of one.
+
+   points are binned into cubes of side `cell' (in cell units), so a
+   query with d <= cell only has to look at the 27 neighbouring
+   cubes.  a larger d works, but looks at more of them. */
+void sep_init(double cell);
+void sep_free(void);
+
+/* add the valid points (x1, x2, x3 > 0) of a finished line */
+void sep_add_line(Real3Vect *xvals, int n);
+
+/* is there a stored point within d of x? */
+int sep_near(Real3Vect *x, double d);
+
+#endif
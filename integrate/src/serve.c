@@ -0,0 +1,376 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serve.h"
+
+#define MAXCLIENT 64
+#define BUFLEN    4096
+
+/* one connection, and the query it is sending or waiting on */
+typedef struct Client_s{
+  int fd;                       /* -1 if this slot is free */
+  FILE *out;
+  char buf[BUFLEN];             /* input not yet split into lines */
+  int len;
+  double par[NSWEEP];           /* its integration parameters */
+  Real3Vect *seeds;
+  int nseed, nwant;             /* seeds read so far, and expected */
+  int queued;                   /* the query is complete, not yet run */
+  double t0;                    /* when the query was complete */
+}Client;
+
+static Client clients[MAXCLIENT];
+static double defaults[NSWEEP];  /* the parameters in the input file */
+static int listen_fd = -1;
+static int quit;
+
+
+static void client_open(int fd_in, FILE *out)
+{
+  int c, p;
+
+  for (c=0; c<MAXCLIENT && clients[c].fd >= 0; c++) ;
+  if (c == MAXCLIENT) {
+    fprintf(out, "# error too many clients\n");
+    fclose(out);
+    return;
+  }
+
+  clients[c].fd = fd_in;
+  clients[c].out = out;
+  clients[c].len = 0;
+  for (p=0; p<NSWEEP; p++)
+    clients[c].par[p] = defaults[p];
+  clients[c].seeds = NULL;
+  clients[c].nseed = clients[c].nwant = 0;
+  clients[c].queued = 0;
+
+  return;
+}
+
+
+static void client_close(Client *cl)
+{
+  /* out shares the descriptor with fd, except on stdin */
+  if (cl->fd != fileno(cl->out))
+    close(cl->fd);
+  fclose(cl->out);
+  if (cl->seeds != NULL)
+    free_1d_array((void*) cl->seeds);
+
+  cl->fd = -1;
+  cl->seeds = NULL;
+  cl->queued = 0;
+
+  /* the only client on stdin going away ends the session */
+  if (listen_fd < 0)
+    quit = 1;
+
+  return;
+}
+
+
+/* act on one line of input */
+static void client_line(Client *cl, char *line)
+{
+  char cmd[64], name[64];
+  double v, x[3];
+  int n, p;
+
+  /* blank lines and comments are skipped anywhere */
+  if (sscanf(line, "%63s", cmd) != 1 || cmd[0] == '#')
+    return;
+
+  /* the points of a query */
+  if (cl->nseed < cl->nwant) {
+    if (sscanf(line, "%le %le %le", &x[0], &x[1], &x[2]) != 3) {
+      fprintf(cl->out, "# error expected a seed point, got: %s\n", line);
+      cl->nwant = cl->nseed = 0;
+      fflush(cl->out);
+      return;
+    }
+
+    /* convert to cell units */
+    n = cl->nseed++;
+    cl->seeds[n].x1 = (x[0] - ox)/dx;
+    cl->seeds[n].x2 = (x[1] - oy)/dy;
+    cl->seeds[n].x3 = (x[2] - oz)/dz;
+
+    if (cl->nseed == cl->nwant) {
+      cl->queued = 1;
+      cl->t0 = wall_time();
+    }
+    return;
+  }
+
+  /* a query may be as big as a batch run (n_lines), no bigger, so
+     that one client can't take the memory every client needs */
+  if (strcmp(cmd, "seeds") == 0) {
+    if (sscanf(line, "%*s %d", &n) != 1 || n < 1 || n > nlines) {
+      fprintf(cl->out, "# error bad query: %s (1 to %d seeds)\n", line,
+              nlines);
+    } else {
+      if (cl->seeds != NULL)
+        free_1d_array((void*) cl->seeds);
+      cl->seeds = (Real3Vect*) calloc_1d_array(n, sizeof(Real3Vect));
+      cl->nwant = n;
+      cl->nseed = 0;
+    }
+  } else if (strcmp(cmd, "set") == 0) {
+    if (sscanf(line, "%*s %63s %le", name, &v) != 2 ||
+        (p = sweep_par(name)) < 0) {
+      fprintf(cl->out, "# error bad parameter: %s\n", line);
+    } else {
+      cl->par[p] = v;
+      fprintf(cl->out, "# set %s %g\n", name, v);
+    }
+  } else if (strcmp(cmd, "quit") == 0) {
+    client_close(cl);
+    return;
+  } else if (strcmp(cmd, "shutdown") == 0) {
+    quit = 1;
+  } else {
+    fprintf(cl->out, "# error unknown command: %s\n", cmd);
+  }
+  fflush(cl->out);
+
+  return;
+}
+
+
+/* act on every complete line of input, up to the end of a query */
+static void client_parse(Client *cl)
+{
+  int start, i;
+
+  for (start=0, i=0; i < cl->len && cl->fd >= 0 && !cl->queued; i++) {
+    if (cl->buf[i] != '\n')
+      continue;
+    cl->buf[i] = '\0';
+    client_line(cl, cl->buf + start);
+    start = i+1;
+  }
+  if (cl->fd < 0)
+    return;
+
+  /* keep the rest for next time.  a line which fills the whole
+     buffer is thrown away. */
+  cl->len -= start;
+  memmove(cl->buf, cl->buf + start, cl->len);
+  if (cl->len == BUFLEN - 1) {
+    fprintf(cl->out, "# error line too long\n");
+    fflush(cl->out);
+    cl->len = 0;
+  }
+
+  return;
+}
+
+
+/* read what there is, and act on it */
+static void client_read(Client *cl)
+{
+  int n;
+
+  n = read(cl->fd, cl->buf + cl->len, BUFLEN - 1 - cl->len);
+  if (n <= 0) {
+    if (n == 0 || (errno != EINTR && errno != EAGAIN))
+      client_close(cl);
+    return;
+  }
+  cl->len += n;
+
+  client_parse(cl);
+
+  return;
+}
+
+
+/* trace every waiting query with the same parameters as the first
+   one, together */
+static void serve_batch(void)
+{
+  int c, first, p, n, total;
+  int *who, *idx, stop[2];
+  Real3Vect *xvals;
+  float **attr;
+  double t;
+
+  for (first=0; first<MAXCLIENT && !clients[first].queued; first++) ;
+  if (first == MAXCLIENT)
+    return;
+
+  for (p=0; p<NSWEEP; p++)
+    sweep_put(p, clients[first].par[p]);
+
+  /* the lines to trace: line idx[n] of client who[n] */
+  for (c=first, total=0; c<MAXCLIENT; c++)
+    if (clients[c].queued &&
+        memcmp(clients[c].par, clients[first].par, sizeof(clients[c].par)) == 0)
+      total += clients[c].nseed;
+
+  who = (int*) calloc_1d_array(total, sizeof(int));
+  idx = (int*) calloc_1d_array(total, sizeof(int));
+  for (c=first, total=0; c<MAXCLIENT; c++) {
+    if (!clients[c].queued ||
+        memcmp(clients[c].par, clients[first].par, sizeof(clients[c].par)) != 0)
+      continue;
+    for (n=0; n<clients[c].nseed; n++) {
+      who[total] = c;
+      idx[total] = n;
+      total++;
+    }
+  }
+
+  t = wall_time();
+
+  /* lines take very different amounts of time, so hand them out one
+     at a time, and send each back as soon as it's done */
+#pragma omp parallel for schedule(dynamic) private(xvals, attr, stop)
+  for (n=0; n<total; n++) {
+    xvals = scratch_line(&attr);
+    xvals[maxstep/2] = clients[who[n]].seeds[idx[n]];
+
+    integrate_line(xvals, attr, idx[n], stop);
+    stats_line(idx[n], stop);
+
+#pragma omp critical (serve_out)
+    {
+      fprintf(clients[who[n]].out, "# line %d %s %s\n", idx[n],
+              stop_names[stop[0]], stop_names[stop[1]]);
+      write_line(clients[who[n]].out, xvals, attr);
+      fflush(clients[who[n]].out);
+    }
+  }
+
+  stats_phase(PHASE_INTEGRATE, wall_time() - t);
+
+  /* the queries are done */
+  for (n=0; n<total; n++) {
+    c = who[n];
+    if (!clients[c].queued)
+      continue;
+
+    fprintf(clients[c].out, "# done %d %.6f\n", clients[c].nseed,
+            wall_time() - clients[c].t0);
+    fflush(clients[c].out);
+
+    free_1d_array((void*) clients[c].seeds);
+    clients[c].seeds = NULL;
+    clients[c].nseed = clients[c].nwant = 0;
+    clients[c].queued = 0;
+  }
+
+  free_1d_array((void*) who);
+  free_1d_array((void*) idx);
+
+  return;
+}
+
+
+void serve_run(char *where)
+{
+  struct sockaddr_un addr;
+  struct pollfd fds[MAXCLIENT+1];
+  int slot[MAXCLIENT+1];
+  int c, n, nfds, fd, busy;
+  FILE *out;
+
+  for (c=0; c<MAXCLIENT; c++)
+    clients[c].fd = -1;
+  for (c=0; c<NSWEEP; c++)
+    defaults[c] = sweep_get(c);
+  quit = 0;
+
+  /* a client which goes away mid-reply shouldn't take us with it */
+  signal(SIGPIPE, SIG_IGN);
+
+  if (strcmp(where, "-") == 0) {
+    /* the replies get stdout to themselves; everything else goes to
+       stderr */
+    fflush(stdout);
+    out = fdopen(dup(fileno(stdout)), "w");
+    dup2(fileno(stderr), fileno(stdout));
+    client_open(fileno(stdin), out);
+    listen_fd = -1;
+  } else {
+    if (strlen(where) >= sizeof(addr.sun_path))
+      ath_error("[serve_run]: socket name too long: %s\n", where);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, where);
+    unlink(where);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 16) != 0)
+      ath_error("[serve_run]: could not listen on %s: %s\n", where,
+                strerror(errno));
+    printf("serving on %s\n", where);
+    fflush(stdout);
+  }
+
+  while (!quit) {
+    /* wait for input, unless there is work to do already.  clients
+       with a query waiting aren't read until it has run. */
+    busy = 0;
+    nfds = 0;
+    if (listen_fd >= 0) {
+      fds[nfds].fd = listen_fd;
+      fds[nfds].events = POLLIN;
+      slot[nfds++] = -1;
+    }
+    for (c=0; c<MAXCLIENT; c++) {
+      if (clients[c].fd < 0)
+        continue;
+      if (clients[c].queued) {
+        busy = 1;
+        continue;
+      }
+      fds[nfds].fd = clients[c].fd;
+      fds[nfds].events = POLLIN;
+      slot[nfds++] = c;
+    }
+
+    if (poll(fds, nfds, busy ? 0 : -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      ath_error("[serve_run]: poll: %s\n", strerror(errno));
+    }
+
+    for (n=0; n<nfds; n++) {
+      if (!(fds[n].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+
+      if (slot[n] < 0) {
+        if ((fd = accept(listen_fd, NULL, NULL)) >= 0)
+          client_open(fd, fdopen(fd, "w"));
+      } else {
+        client_read(&clients[slot[n]]);
+      }
+    }
+
+    serve_batch();
+
+    /* carry on with whatever came in behind the queries just run */
+    for (c=0; c<MAXCLIENT; c++)
+      if (clients[c].fd >= 0 && !clients[c].queued && clients[c].len > 0)
+        client_parse(&clients[c]);
+  }
+
+  for (c=0; c<MAXCLIENT; c++)
+    if (clients[c].fd >= 0)
+      client_close(&clients[c]);
+
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(where);
+  }
+
+  return;
+}
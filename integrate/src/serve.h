@@ -0,0 +1,52 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+#include "stats.h"
+#include "lines.h"
+#include "sweep.h"
+
+/* server mode: keep the field in memory and trace lines from seeds
+   sent in by clients, so that exploring a field doesn't mean reading
+   it again for every new set of seeds.
+
+   the server listens on a UNIX socket (serve = /tmp/flines.sock in
+   the files block), or talks to a single client on stdin and stdout
+   (serve = -; anything else flines prints goes to stderr then).  the
+   protocol is text, one command per line:
+
+     set <name> <value>   set an integration parameter for this
+                          client's later queries: one of those which
+                          can be swept (see sweep.h)
+     seeds <n>            a query: n seed points follow, one per line
+                          as "x y z" in physical units, as in a seed
+                          file.  the lines are traced as soon as the
+                          last one arrives.  n is at most n_lines.
+     quit                 close this connection
+     shutdown             stop the server
+
+   replies are a .flines file, with the framing in comments: each line
+   comes back as soon as it is finished, in whatever order, as
+
+     # line <i> <stop forward> <stop backward>
+     x y z ...            (as in write_data())
+     <blank line>
+
+   where i counts from 0 within the query, and when the whole query is
+   done, "# done <n> <seconds>".  errors come back as "# error ...".
+   "set" is acknowledged with "# set <name> <value>".
+
+   line i of a query is traced exactly as line i of a batch run with
+   the same seeds and parameters would be.  queries from several
+   clients which have the same parameters are run together, with
+   their lines shared out among all the threads. */
+void serve_run(char *where);
+
+#endif
@@ -0,0 +1,319 @@
+#include <stddef.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+char *stop_names[NSTOP] = {
+  "boundary", "closed", "maxlen", "xeno", "neighbour", "step_limit", "chaos_cut",
+  "null"
+};
+
+static char *phase_names[NPHASE] = {
+  "parse", "load", "normalize", "seed", "integrate", "write"
+};
+
+static Stats serial_stats;
+static Stats *slots = &serial_stats;
+static int nslots = 1;
+static int nranks = 1;
+static long rss_ranks = 0;      /* largest peak over the ranks, in kB */
+static int seed_redraws = 0;    /* see stats_seeds() */
+static int seed_dead = 0;
+
+static double phase_time[NPHASE];
+
+/* stopping reasons of each line, packed as 8*forward + backward */
+static unsigned char *line_stops = NULL;
+static int nline_stops = 0;
+
+
+void stats_init(int nlines)
+{
+#ifdef _OPENMP
+  nslots = omp_get_max_threads();
+#else
+  nslots = 1;
+#endif
+
+  slots = (Stats*) calloc_1d_array(nslots, sizeof(Stats));
+
+  nline_stops = nlines;
+  line_stops = (unsigned char*) calloc_1d_array(nlines, sizeof(unsigned char));
+  memset(line_stops, 0xff, nlines);
+
+  return;
+}
+
+
+void stats_free(void)
+{
+  if (slots != &serial_stats)
+    free_1d_array((void*) slots);
+  if (line_stops != NULL)
+    free_1d_array((void*) line_stops);
+
+  slots = &serial_stats;
+  nslots = 1;
+  line_stops = NULL;
+  nline_stops = 0;
+
+  return;
+}
+
+
+Stats *stats_local(void)
+{
+#ifdef _OPENMP
+  int t = omp_get_thread_num();
+  return &slots[t < nslots ? t : 0];
+#else
+  return &slots[0];
+#endif
+}
+
+
+void stats_sum(Stats *tot)
+{
+  int s, b;
+
+  memset(tot, 0, sizeof(Stats));
+
+  for (s=0; s<nslots; s++) {
+    tot->accepted += slots[s].accepted;
+    tot->rejected += slots[s].rejected;
+    tot->giveups  += slots[s].giveups;
+    tot->allocs   += slots[s].allocs;
+    tot->alloc_bytes += slots[s].alloc_bytes;
+    tot->chaos_dirs    += slots[s].chaos_dirs;
+    tot->chaos_agree   += slots[s].chaos_agree;
+    tot->chaos_earlier += slots[s].chaos_earlier;
+    tot->chaos_later   += slots[s].chaos_later;
+    tot->chaos_shift   += slots[s].chaos_shift;
+    tot->chaos_points  += slots[s].chaos_points;
+    for (b=0; b<4; b++)
+      tot->chaos_log[b] += slots[s].chaos_log[b];
+    tot->chaos_cuts    += slots[s].chaos_cuts;
+    tot->chaos_cut_log += slots[s].chaos_cut_log;
+
+    for (b=0; b<NHIST; b++)
+      tot->hist[b] += slots[s].hist[b];
+    for (b=0; b<NSTOP; b++)
+      tot->stops[b] += slots[s].stops[b];
+  }
+
+  return;
+}
+
+
+void stats_step(double h, int nreject, int giveup)
+{
+  Stats *st = stats_local();
+  int e;
+
+  st->accepted++;
+  st->rejected += nreject;
+  st->giveups  += giveup;
+
+  frexp(h, &e);
+  e = MIN(MAX(e + 24, 0), NHIST-1);
+  st->hist[e]++;
+
+  return;
+}
+
+
+void stats_alloc(int n, long bytes)
+{
+  Stats *st = stats_local();
+
+  st->allocs += n;
+  st->alloc_bytes += bytes;
+
+  return;
+}
+
+
+void stats_chaos(int cut_b, int cut_t, double st_cut, double *lsum, int n)
+{
+  Stats *st = stats_local();
+  int b;
+
+  st->chaos_dirs++;
+  if ((cut_b < 0) == (cut_t < 0))
+    st->chaos_agree++;
+  if (cut_t >= 0 && (cut_b < 0 || cut_t < cut_b))
+    st->chaos_earlier++;
+  if (cut_b >= 0 && (cut_t < 0 || cut_t > cut_b))
+    st->chaos_later++;
+  if (cut_b >= 0 && cut_t >= 0)
+    st->chaos_shift += abs(cut_t - cut_b);
+  if (cut_b >= 0 && st_cut > 0.0 && st_cut < HUGE_VAL) {
+    st->chaos_cuts++;
+    st->chaos_cut_log += (long) floor(1.0e3*log10(st_cut) + 0.5);
+  }
+
+  st->chaos_points += n;
+  for (b=0; b<4; b++)
+    st->chaos_log[b] += (long) floor(((b%2) ? 1.0e6 : 1.0e3)*lsum[b] + 0.5);
+
+  return;
+}
+
+
+void stats_seeds(int nredraw, int ndead)
+{
+  seed_redraws = nredraw;
+  seed_dead = ndead;
+
+  return;
+}
+
+
+void stats_line(int line, int *stop)
+{
+  Stats *st = stats_local();
+
+  st->stops[stop[0]]++;
+  st->stops[stop[1]]++;
+
+  if (line < nline_stops)
+    line_stops[line] = 8*stop[0] + stop[1];
+
+  return;
+}
+
+
+double wall_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+
+void stats_phase(int phase, double t)
+{
+  phase_time[phase] += t;
+
+  return;
+}
+
+
+/* the most memory this process has held, in kB */
+static long peak_rss(void)
+{
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return -1;
+
+  return MAX(ru.ru_maxrss, rss_ranks);
+}
+
+
+#ifdef MPI_PARALLEL
+void stats_reduce_mpi(MPI_Comm comm)
+{
+  Stats tot, all;
+  int myid;
+  long rss;
+
+  MPI_Comm_rank(comm, &myid);
+  MPI_Comm_size(comm, &nranks);
+
+  /* everything up to the padding is a long */
+  stats_sum(&tot);
+  memset(&all, 0, sizeof(Stats));
+  MPI_Reduce(&tot, &all, (int) (offsetof(Stats, pad)/sizeof(long)),
+             MPI_LONG, MPI_SUM, 0, comm);
+
+  rss = peak_rss();
+  MPI_Reduce(&rss, &rss_ranks, 1, MPI_LONG, MPI_MAX, 0, comm);
+
+  if (myid == 0) {
+    memset(slots, 0, nslots*sizeof(Stats));
+    memcpy(&slots[0], &all, sizeof(Stats));
+  }
+
+  return;
+}
+#endif
+
+
+void stats_write(FILE *fp)
+{
+  Stats tot;
+  int b, n, first;
+  double total;
+
+  stats_sum(&tot);
+
+  fprintf(fp, "{\n  \"phases\": {");
+  total = 0.0;
+  for (b=0; b<NPHASE; b++) {
+    fprintf(fp, "%s\"%s\": %.6f", b ? ", " : "", phase_names[b], phase_time[b]);
+    total += phase_time[b];
+  }
+  fprintf(fp, ", \"total\": %.6f},\n", total);
+
+  fprintf(fp, "  \"ranks\": %d,\n", nranks);
+  fprintf(fp, "  \"threads\": %d,\n", nslots);
+  fprintf(fp, "  \"peak_rss_kb\": %ld,\n", peak_rss());
+  fprintf(fp, "  \"seed_redraws\": %d,\n", seed_redraws);
+  fprintf(fp, "  \"dead_seeds\": %d,\n", seed_dead);
+  fprintf(fp, "  \"field_lookups\": %ld,\n", FIELD_LOOKUPS(tot.accepted, tot.rejected));
+  fprintf(fp, "  \"steps_accepted\": %ld,\n", tot.accepted);
+  fprintf(fp, "  \"steps_rejected\": %ld,\n", tot.rejected);
+  fprintf(fp, "  \"qc_step_giveups\": %ld,\n", tot.giveups);
+  fprintf(fp, "  \"scratch_allocs\": %ld,\n", tot.allocs);
+  fprintf(fp, "  \"scratch_bytes\": %ld,\n", tot.alloc_bytes);
+
+  /* only print the occupied part of the histogram */
+  fprintf(fp, "  \"step_size_hist\": {");
+  for (b=0, first=1; b<NHIST; b++) {
+    if (tot.hist[b] == 0) continue;
+    fprintf(fp, "%s\"%g\": %ld", first ? "" : ", ", ldexp(1.0, b-25), tot.hist[b]);
+    first = 0;
+  }
+  fprintf(fp, "},\n");
+
+  /* log10(tangent/bundle spread): mean and rms, against the spread
+     the cut uses and against the closest approach */
+  if (tot.chaos_dirs > 0) {
+    double np = MAX(tot.chaos_points, 1);
+    fprintf(fp, "  \"chaos_compare\": {\"directions\": %ld, \"agree\": %ld, "
+            "\"tangent_earlier\": %ld, \"tangent_later\": %ld, "
+            "\"cut_shift\": %ld, \"points\": %ld,\n", tot.chaos_dirs,
+            tot.chaos_agree, tot.chaos_earlier, tot.chaos_later,
+            tot.chaos_shift, tot.chaos_points);
+    fprintf(fp, "    \"log10_ratio\": [%.4f, %.4f], \"log10_ratio_closest\": [%.4f, %.4f],\n",
+            1.0e-3*tot.chaos_log[0]/np, sqrt(1.0e-6*tot.chaos_log[1]/np),
+            1.0e-3*tot.chaos_log[2]/np, sqrt(1.0e-6*tot.chaos_log[3]/np));
+    /* the geometric mean of the tangent spread where the bundle cut */
+    if (tot.chaos_cuts > 0)
+      fprintf(fp, "    \"matching_tangent_cut\": %.4g},\n",
+              pow(10.0, 1.0e-3*tot.chaos_cut_log/tot.chaos_cuts));
+    else
+      fprintf(fp, "    \"matching_tangent_cut\": null},\n");
+  }
+
+  fprintf(fp, "  \"stops\": {");
+  for (b=0; b<NSTOP; b++)
+    fprintf(fp, "%s\"%s\": %ld", b ? ", " : "", stop_names[b], tot.stops[b]);
+  fprintf(fp, "},\n");
+
+  fprintf(fp, "  \"line_stops\": [");
+  for (n=0, first=1; n<nline_stops; n++) {
+    if (line_stops[n] == 0xff) continue;
+    fprintf(fp, "%s\n    [%d, \"%s\", \"%s\"]", first ? "" : ",", n,
+            stop_names[line_stops[n]/8], stop_names[line_stops[n]%8]);
+    first = 0;
+  }
+  fprintf(fp, "\n  ]\n}\n");
+
+  return;
+}
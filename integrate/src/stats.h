@@ -0,0 +1,124 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+
+#ifdef MPI_PARALLEL
+#include <mpi.h>
+#endif
+
+/* run-time counters and phase timers.
+
+   each thread counts into its own slot, so the hot path is a plain
+   increment with no locking; stats_write() adds up the slots at the
+   end of the run.  field lookups aren't counted one by one: every
+   call to RK4_qc_step() costs one, for B at the starting point, and
+   every trial step 10 more. */
+#define FIELD_LOOKUPS(accepted, rejected) (11*(accepted) + 10*(rejected))
+
+/* why a line stopped, in one direction */
+enum {
+  STOP_BOUNDARY,                /* left the box */
+  STOP_CLOSED,                  /* loop closed */
+  STOP_MAXLEN,                  /* reached line_length */
+  STOP_XENO,                    /* B ~ 0 */
+  STOP_NEIGHBOUR,               /* came within d_test of another line */
+  STOP_STEPLIMIT,               /* ran out of steps */
+  STOP_CHAOS,                   /* cut off where the bundle diverged */
+  STOP_NULL,                    /* ran into a dead region (see nulls.h) */
+  NSTOP
+};
+
+/* run phases timed in main() */
+enum {
+  PHASE_PARSE, PHASE_LOAD, PHASE_NORMALIZE, PHASE_SEED,
+  PHASE_INTEGRATE, PHASE_WRITE,
+  NPHASE
+};
+
+/* step-size histogram: bin b holds steps with 2^(b-25) <= h < 2^(b-24) */
+#define NHIST 32
+
+typedef struct Stats_s{
+  long accepted;                /* steps taken by RK4_qc_step */
+  long rejected;                /* trial steps thrown away */
+  long giveups;                 /* steps taken without meeting tolerance */
+  long allocs;                  /* heap allocations for tracing lines */
+  long alloc_bytes;
+  long hist[NHIST];             /* accepted step sizes */
+  long stops[NSTOP];            /* main lines only, one per direction */
+  long chaos_dirs;              /* directions cut both ways (see
+                                   CHAOS_COMPARE in lines.h) */
+  long chaos_agree;             /* ...which both cut, or neither did */
+  long chaos_earlier;           /* ...which the tangent cut shorter */
+  long chaos_later;             /* ...or longer, or only the bundle cut */
+  long chaos_shift;             /* points between the cuts, if both cut */
+  long chaos_points;            /* points where both spreads were known */
+  long chaos_log[4];            /* sums of log10(tangent/bundle) there
+                                   and its square, then the same with
+                                   the closest approach of the bundle;
+                                   in 1e-3 and 1e-6 */
+  long chaos_cuts;              /* directions the bundle cut... */
+  long chaos_cut_log;           /* ...and the sum of log10 of the
+                                   tangent spread there, in 1e-3 */
+  char pad[64];                 /* keep threads off each other's lines */
+}Stats;
+
+extern char *stop_names[NSTOP];
+
+/* allocate one slot per thread, and room for the stopping reasons of
+   nlines lines.  until this is called, everything is counted in a
+   single slot. */
+void stats_init(int nlines);
+void stats_free(void);
+
+Stats *stats_local(void);
+
+/* add up every slot into tot */
+void stats_sum(Stats *tot);
+
+/* record one accepted step of size h, after nreject failed trials */
+void stats_step(double h, int nreject, int giveup);
+
+/* n allocations of bytes in all, made while tracing lines (for
+   scratch space, see lines.h).  once every thread has what it needs,
+   this should stop growing. */
+void stats_alloc(int n, long bytes);
+
+/* one direction of a line cut both ways: where the bundle and the
+   tangent cut it (points from the seed, or -1 if they didn't), the
+   tangent spread where the bundle cut (in cells of the full grid, as
+   tangent_cut is given), and, over the n points before the first
+   cut, the sum and sum of squares of log10(tangent/bundle spread),
+   then of log10(tangent/closest approach) */
+void stats_chaos(int cut_b, int cut_t, double st_cut, double *lsum, int n);
+
+/* how often random seeds were drawn again to keep them out of the
+   dead regions around nulls, and how many were left in one anyway
+   (see get_seed_points()).  every rank draws the same seeds, so these
+   aren't added up over ranks. */
+void stats_seeds(int nredraw, int ndead);
+
+/* per-line stopping reasons, forward and backward */
+void stats_line(int line, int *stop);
+
+double wall_time(void);
+void stats_phase(int phase, double t);
+
+void stats_write(FILE *fp);
+
+#ifdef MPI_PARALLEL
+/* add the counters of every rank into rank 0, which writes them out
+   with the largest peak RSS of any rank.  the per-line stops are
+   already there: rank 0 collects the lines. */
+void stats_reduce_mpi(MPI_Comm comm);
+#endif
+
+#endif
@@ -0,0 +1,243 @@
+#include <stddef.h>
+#include "sweep.h"
+
+/* a parameter which can be swept, the global it sets, and the values
+   to try */
+typedef struct SweepPar_s{
+  char *name;                   /* in the integration block */
+  double *dval;                 /* set this... */
+  int *ival;                    /* ...or this */
+  int cells;                    /* given in box units; times Nx_all */
+  int full;                     /* given in full grid cells; over lod */
+  int nval;
+  double *val;
+}SweepPar;
+
+static SweepPar pars[NSWEEP] = {
+  {"tolerance",   &tolerance,    NULL,     0, 0, 0, NULL},
+  {"chaos_cut",   &chaos_cut,    NULL,     0, 1, 0, NULL},
+  {"tangent_cut", &tangent_cut,  NULL,     0, 1, 0, NULL},
+  {"n_bundle",    NULL,          &nbundle, 0, 0, 0, NULL},
+  {"close_lo",    &close_lo,     NULL,     0, 1, 0, NULL},
+  {"close_hi",    &close_hi,     NULL,     0, 1, 0, NULL},
+  {"line_length", &maxlen,       NULL,     1, 0, 0, NULL},
+  {"xeno",        &xeno,         NULL,     0, 0, 0, NULL}
+};
+
+static int ncfg = 1;
+
+static Stats start;
+static double start_time;
+
+
+int sweep_init(void)
+{
+  int p, n;
+  char *s, *c;
+
+  ncfg = 1;
+  for (p=0; p<NSWEEP; p++) {
+    s = par_gets_def("sweep", pars[p].name, NULL);
+    if (s == NULL)
+      continue;
+
+    /* count the commas, then read the values */
+    for (n=1, c=s; *c != '\0'; c++)
+      if (*c == ',') n++;
+
+    pars[p].val = (double*) calloc_1d_array(n, sizeof(double));
+    for (n=0, c=s; c != NULL; c = strchr(c, ',')) {
+      if (*c == ',') c++;
+      pars[p].val[n++] = atof(c);
+    }
+    pars[p].nval = n;
+    ncfg *= n;
+
+    free(s);
+  }
+
+  return ncfg;
+}
+
+
+void sweep_free(void)
+{
+  int p;
+
+  for (p=0; p<NSWEEP; p++) {
+    if (pars[p].val != NULL)
+      free_1d_array((void*) pars[p].val);
+    pars[p].val = NULL;
+    pars[p].nval = 0;
+  }
+  ncfg = 1;
+
+  return;
+}
+
+
+/* which value of parameter p goes with configuration n.  the last
+   parameter in the table changes fastest. */
+static double sweep_value(int p, int n)
+{
+  int q;
+
+  for (q=NSWEEP-1; q>p; q--)
+    if (pars[q].nval > 0)
+      n /= pars[q].nval;
+
+  return pars[p].val[n % pars[p].nval];
+}
+
+
+void sweep_set(int n)
+{
+  int p;
+
+  for (p=0; p<NSWEEP; p++)
+    if (pars[p].nval > 0)
+      sweep_put(p, sweep_value(p, n));
+
+  return;
+}
+
+
+int sweep_par(char *name)
+{
+  int p;
+
+  for (p=0; p<NSWEEP; p++)
+    if (strcmp(name, pars[p].name) == 0)
+      return p;
+
+  return -1;
+}
+
+
+char *sweep_name_of(int p)
+{
+  return pars[p].name;
+}
+
+
+double sweep_get(int p)
+{
+  double v;
+
+  v = (pars[p].dval != NULL) ? *pars[p].dval : *pars[p].ival;
+  if (pars[p].cells)
+    v /= Nx_all;
+  if (pars[p].full)
+    v *= lod;
+
+  return v;
+}
+
+
+void sweep_put(int p, double v)
+{
+  if (pars[p].cells)
+    v *= Nx_all;
+  if (pars[p].full)
+    v /= lod;
+
+  if (pars[p].dval != NULL)
+    *pars[p].dval = v;
+  else
+    *pars[p].ival = (int) v;
+
+  return;
+}
+
+
+void sweep_name(char *outfname, int n, char *name)
+{
+  char tag[32];
+
+  if (ncfg == 1) {
+    strcpy(name, outfname);
+    return;
+  }
+
+  sprintf(tag, "%d", n);
+  tag_name(outfname, tag, name);
+
+  return;
+}
+
+
+/* the counters of every thread, and every rank */
+static void sweep_counters(Stats *st)
+{
+#ifdef MPI_PARALLEL
+  Stats mine;
+
+  stats_sum(&mine);
+  memset(st, 0, sizeof(Stats));
+  MPI_Allreduce(&mine, st, (int) (offsetof(Stats, pad)/sizeof(long)),
+                MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+#else
+  stats_sum(st);
+#endif
+
+  return;
+}
+
+
+void sweep_begin(void)
+{
+  sweep_counters(&start);
+  start_time = wall_time();
+
+  return;
+}
+
+
+void sweep_row(FILE *fp, int n, Real3Vect **xvals)
+{
+  Stats now;
+  int p, i, j, b;
+  long npts;
+  double t;
+
+  t = wall_time() - start_time;
+  sweep_counters(&now);
+
+  if (fp == NULL)
+    return;
+
+  if (n == 0) {
+    fprintf(fp, "# cfg");
+    for (p=0; p<NSWEEP; p++)
+      if (pars[p].nval > 0)
+        fprintf(fp, " %12s", pars[p].name);
+    fprintf(fp, " %10s %10s %10s %8s %10s", "time[s]", "steps", "rejected",
+            "giveups", "points");
+    for (b=0; b<NSTOP; b++)
+      fprintf(fp, " %10s", stop_names[b]);
+    fprintf(fp, "\n");
+  }
+
+  /* points kept per line, after the chaos cut */
+  npts = 0;
+  if (xvals != NULL)
+    for (i=0; i<nlines; i++)
+      for (j=0; j<maxstep; j++)
+        if (xvals[i][j].x1 != -1.0) npts++;
+
+  fprintf(fp, "%5d", n);
+  for (p=0; p<NSWEEP; p++)
+    if (pars[p].nval > 0)
+      fprintf(fp, " %12g", sweep_value(p, n));
+  fprintf(fp, " %10.3f %10ld %10ld %8ld %10.1f", t,
+          now.accepted - start.accepted,
+          now.rejected - start.rejected,
+          now.giveups  - start.giveups,
+          (double) npts / MAX(nlines, 1));
+  for (b=0; b<NSTOP; b++)
+    fprintf(fp, " %10ld", now.stops[b] - start.stops[b]);
+  fprintf(fp, "\n");
+  fflush(fp);
+
+  return;
+}
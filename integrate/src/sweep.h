@@ -0,0 +1,63 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "stats.h"
+#include "lines.h"
+#include "par.h"
+
+/* parameter sweeps.  a <sweep> block in the input file gives lists
+   of values to try for some of the integration parameters:
+
+     <sweep>
+     tolerance = 1.0e-6,1.0e-5,1.0e-4
+     chaos_cut = 2.0,5.0
+
+   the same goes on the command line as sweep/chaos_cut=2.0,5.0 (if
+   the input file has a <sweep> block, even an empty one), or as
+   -p integration/chaos_cut=2.0,5.0.  the parameters which can be
+   swept are tolerance, chaos_cut, tangent_cut, n_bundle, close_lo,
+   close_hi, line_length and xeno.
+
+   the field is read, normalized and seeded once, then every
+   combination is run in turn, with its lines shared out among the
+   threads (and ranks) as usual.  configuration n is written to the
+   output file with .n before the extension (cloud.0100.flines ->
+   cloud.0100.3.flines), and gets a row in a table of timings, work
+   and stopping reasons. */
+
+/* read the <sweep> block; call before par_close().  returns the
+   number of configurations, 1 if there is nothing to sweep. */
+int sweep_init(void);
+void sweep_free(void);
+
+/* set the integration parameters for configuration n.  line_length
+   is in box units, so call this after the field is loaded. */
+void sweep_set(int n);
+
+/* the output file name for configuration n */
+void sweep_name(char *outfname, int n, char *name);
+
+/* time configuration n, and add its row to the table in fp (only
+   where fp is not NULL; under MPI every rank must call these).
+   xvals may be NULL. */
+void sweep_begin(void);
+void sweep_row(FILE *fp, int n, Real3Vect **xvals);
+
+/* the same parameters one at a time, by index (as for serve.h).
+   sweep_par() gives the index of name, or -1, and sweep_name_of() the
+   name of index p; sweep_get() and sweep_put() read and set the
+   global, with line_length in box units. */
+#define NSWEEP 8
+int sweep_par(char *name);
+char *sweep_name_of(int p);
+double sweep_get(int p);
+void sweep_put(int p, double v);
+
+#endif
@@ -0,0 +1,261 @@
+#include "synth.h"
+
+#define NLOOPS 48
+
+/* small, portable generator so the fields don't depend on rand() */
+static double synth_rand(unsigned long *state)
+{
+  *state = (*state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  return (double) *state / 0x7fffffffUL;
+}
+
+
+static void uniform_field(double x, double y, double z, Real3Vect *b)
+{
+  (void) x;  (void) y;  (void) z;
+
+  b->x1 = 1.0;
+  b->x2 = 0.5;
+  b->x3 = 0.25;
+
+  return;
+}
+
+
+static void abc_field(double x, double y, double z, Real3Vect *b)
+{
+  /* one period across the box */
+  x = 2.0*PI*(x + 0.5);
+  y = 2.0*PI*(y + 0.5);
+  z = 2.0*PI*(z + 0.5);
+
+  b->x1 = sin(z) + cos(y);
+  b->x2 = sin(x) + cos(z);
+  b->x3 = sin(y) + cos(x);
+
+  return;
+}
+
+
+static void dipole_field(double x, double y, double z, Real3Vect *b)
+{
+  double r2, r5;
+
+  /* moment along z; soften the singularity over a couple of cells */
+  r2 = SQR(x) + SQR(y) + SQR(z) + SQR(2.0*dx);
+  r5 = r2*r2*sqrt(r2);
+
+  b->x1 = 3.0*z*x / r5;
+  b->x2 = 3.0*z*y / r5;
+  b->x3 = (3.0*z*z - r2) / r5;
+
+  return;
+}
+
+
+/* each loop is a ring of radius R about the axis n through c, with a
+   gaussian cross-section of width w.  the field circulates in the
+   plane of the ring. */
+typedef struct Loop_s{
+  Real3Vect c, n;
+  double R, w;
+}Loop;
+
+static Loop loops[NLOOPS];
+
+static void make_loops(void)
+{
+  int l;
+  unsigned long seed = 20130917UL;
+  double r, th, ph, norm;
+
+  for (l=0; l<NLOOPS; l++) {
+    /* centers inside a ball of radius 0.2 */
+    do {
+      loops[l].c.x1 = 0.4*synth_rand(&seed) - 0.2;
+      loops[l].c.x2 = 0.4*synth_rand(&seed) - 0.2;
+      loops[l].c.x3 = 0.4*synth_rand(&seed) - 0.2;
+      r = SQR(loops[l].c.x1) + SQR(loops[l].c.x2) + SQR(loops[l].c.x3);
+    } while (r > SQR(0.2));
+
+    /* isotropic axes */
+    th = acos(2.0*synth_rand(&seed) - 1.0);
+    ph = 2.0*PI*synth_rand(&seed);
+    loops[l].n.x1 = sin(th)*cos(ph);
+    loops[l].n.x2 = sin(th)*sin(ph);
+    loops[l].n.x3 = cos(th);
+
+    norm = sqrt(SQR(loops[l].n.x1) + SQR(loops[l].n.x2) + SQR(loops[l].n.x3));
+    loops[l].n.x1 /= norm;
+    loops[l].n.x2 /= norm;
+    loops[l].n.x3 /= norm;
+
+    loops[l].R = 0.05 + 0.1*synth_rand(&seed);
+    loops[l].w = 0.3*loops[l].R;
+  }
+
+  return;
+}
+
+static void tangled_field(double x, double y, double z, Real3Vect *b)
+{
+  int l;
+  Real3Vect r, rp;
+  double zeta, rho, amp;
+
+  b->x1 = b->x2 = b->x3 = 0.0;
+
+  for (l=0; l<NLOOPS; l++) {
+    r.x1 = x - loops[l].c.x1;
+    r.x2 = y - loops[l].c.x2;
+    r.x3 = z - loops[l].c.x3;
+
+    /* split r into components along and perpendicular to the axis */
+    zeta = r.x1*loops[l].n.x1 + r.x2*loops[l].n.x2 + r.x3*loops[l].n.x3;
+    rp.x1 = r.x1 - zeta*loops[l].n.x1;
+    rp.x2 = r.x2 - zeta*loops[l].n.x2;
+    rp.x3 = r.x3 - zeta*loops[l].n.x3;
+    rho = sqrt(SQR(rp.x1) + SQR(rp.x2) + SQR(rp.x3));
+
+    if (rho < TINY_NUMBER)
+      continue;
+
+    amp = exp(-(SQR(rho - loops[l].R) + SQR(zeta)) / SQR(loops[l].w)) / rho;
+
+    /* phi-hat = n x rp / |rp| */
+    b->x1 += amp * (loops[l].n.x2*rp.x3 - loops[l].n.x3*rp.x2);
+    b->x2 += amp * (loops[l].n.x3*rp.x1 - loops[l].n.x1*rp.x3);
+    b->x3 += amp * (loops[l].n.x1*rp.x2 - loops[l].n.x2*rp.x1);
+  }
+
+  return;
+}
+
+
+typedef void (*SynthFunc)(double x, double y, double z, Real3Vect *b);
+
+/* the field called name, on an n^3 grid spanning [-0.5, 0.5]^3 */
+static SynthFunc synth_grid(char *name, int n)
+{
+  SynthFunc field;
+
+  if (strcmp(name, "uniform") == 0)
+    field = uniform_field;
+  else if (strcmp(name, "abc") == 0)
+    field = abc_field;
+  else if (strcmp(name, "dipole") == 0)
+    field = dipole_field;
+  else if (strcmp(name, "tangled") == 0) {
+    field = tangled_field;
+    make_loops();
+  }
+  else {
+    ath_error("[synth_field]: unknown field %s\n", name);
+    return NULL;
+  }
+
+  Nx = Ny = Nz = n;
+  Klo = 0;  Khi = Nz;
+  vtk_whole();
+  ox = oy = oz = -0.5;
+  dx = dy = dz = 1.0/n;
+
+  return field;
+}
+
+
+void synth_field(char *name, int n)
+{
+  int i, j, k;
+  double x, y, z;
+  SynthFunc field;
+
+  field = synth_grid(name, n);
+
+  B = (Real3Vect***) calloc_3d_array(Nz, Ny, Nx, sizeof(Real3Vect));
+
+  for(k=0; k<Nz; k++){
+    for(j=0; j<Ny; j++){
+      for(i=0; i<Nx; i++){
+        cc_pos(i, j, k, &x, &y, &z);
+        field(x, y, z, &B[k][j][i]);
+      }
+    }
+  }
+
+  return;
+}
+
+
+void synth_write(FILE *fp, char *name, int n)
+{
+  int i, j, k;
+  double x, y, z;
+  float *plane;
+  Real3Vect b;
+  union Float_u dat;
+  SynthFunc field;
+  char comment[256];
+  int swap;
+
+  field = synth_grid(name, n);
+  swap = !is_big_endian();
+
+  sprintf(comment, "synthetic %s field, %d^3 (flines_synth)", name, n);
+  vtkwrite_header(fp, comment);
+  fprintf(fp, "VECTORS cell_centered_B float\n");
+
+  plane = (float*) calloc_1d_array(3*Nx*Ny, sizeof(float));
+
+  for(k=0; k<Nz; k++){
+#pragma omp parallel for private(i, x, y, z, b, dat)
+    for(j=0; j<Ny; j++){
+      for(i=0; i<Nx; i++){
+        cc_pos(i, j, k, &x, &y, &z);
+        field(x, y, z, &b);
+
+        /* VTK BINARY files are defined to be big-endian */
+        dat.f = b.x1;
+        if (swap) dat.i = Flip_int32(dat.i);
+        plane[3*(j*Nx+i)] = dat.f;
+        dat.f = b.x2;
+        if (swap) dat.i = Flip_int32(dat.i);
+        plane[3*(j*Nx+i)+1] = dat.f;
+        dat.f = b.x3;
+        if (swap) dat.i = Flip_int32(dat.i);
+        plane[3*(j*Nx+i)+2] = dat.f;
+      }
+    }
+
+    if (fwrite(plane, sizeof(float), 3*Nx*Ny, fp) != (size_t) 3*Nx*Ny)
+      ath_error("[synth_write]: Error writing cell_centered_B\n");
+  }
+
+  free_1d_array((void*) plane);
+
+  return;
+}
+
+
+void synth_seeds(FILE *fp, char *name, int nseed)
+{
+  int n;
+  unsigned long seed = 1UL;
+  double x, y, z, r;
+
+  fprintf(fp, "# time = 0.000000\n");
+
+  for (n=0; n<nseed; n++) {
+    /* where the loops are, or anywhere away from the boundary */
+    do {
+      x = 0.9*synth_rand(&seed) - 0.45;
+      y = 0.9*synth_rand(&seed) - 0.45;
+      z = 0.9*synth_rand(&seed) - 0.45;
+      r = sqrt(SQR(x) + SQR(y) + SQR(z));
+    } while (strcmp(name, "tangled") == 0 && r > 0.25);
+
+    fprintf(fp, "%d\t%f\t%f\t%f\n", n, x, y, z);
+  }
+
+  return;
+}
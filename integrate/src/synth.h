@@ -0,0 +1,39 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <math.h>
+#include <string.h>
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+
+/* variables defined in vtk.c */
+extern int Nx, Ny, Nz;
+extern double ox, oy, oz;
+extern double dx, dy, dz;
+extern Real3Vect ***B;
+extern int Klo, Khi;
+
+/* analytic test fields, for benchmarking without simulation data.
+   allocates B on an n^3 grid spanning [-0.5, 0.5]^3 and fills it
+   with one of:
+
+     uniform - a constant field, oblique to the grid
+     abc     - Arnold-Beltrami-Childress flow, A = B = C = 1
+     dipole  - a point dipole at the origin, softened over 2 cells
+     tangled - a ball of randomly oriented flux loops
+
+   the result is not normalized; call normalize_B() as usual. */
+void synth_field(char *name, int n);
+
+/* the same field, written straight to fp as a legacy vtk file a plane
+   at a time, so that grids too big to hold can be made; and nseed
+   seed points for it, in the format of athena's seed files (inside
+   the ball of loops for tangled, otherwise anywhere 0.05 from the
+   boundary).  the grid variables are set as by synth_field(), but B
+   isn't touched. */
+void synth_write(FILE *fp, char *name, int n);
+void synth_seeds(FILE *fp, char *name, int nseed);
+
+#endif
@@ -0,0 +1,83 @@
+/*==============================================================================
+ * FILE: synth_vtk.c
+ *
+ * PURPOSE: writes the analytic fields in synth.c as legacy vtk files,
+ *   with a seed file to go with each, so that whole runs of flines can
+ *   be timed on inputs anyone can make (see scripts/scaling.rb).
+ *
+ * USAGE: ./flines_synth [-f field] [-n size] [-s nseed] [-o out.vtk]
+ *
+ *   field is uniform, abc, dipole or tangled (the default), on a
+ *   size^3 grid (default 64).  the output defaults to
+ *   <field>.<size>.vtk, with the size in 4 digits like a snapshot
+ *   number, and the nseed seeds (default 1000) go to
+ *   <field>.<size>.seed.lis, as mk-flines.rb expects.  the field is
+ *   written a plane at a time, so 1024^3 needs no more memory than a
+ *   plane.
+ *============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+#include "stats.h"
+#include "synth.h"
+
+
+int main(int argc, char *argv[])
+{
+  int i, n = 64, nseed = 1000;
+  char *name = "tangled", *out = NULL, vtkname[512], seedname[512];
+  FILE *fp;
+  double t;
+
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+      name = argv[++i];
+    else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      n = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+      nseed = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+      out = argv[++i];
+    else
+      ath_error("usage: %s [-f field] [-n size] [-s nseed] [-o out.vtk]\n",
+                argv[0]);
+  }
+  if (n < 2)
+    ath_error("[flines_synth]: size %d is too small\n", n);
+
+  if (out == NULL)
+    i = snprintf(vtkname, sizeof(vtkname), "%s.%04d.vtk", name, n);
+  else
+    i = snprintf(vtkname, sizeof(vtkname), "%s", out);
+  if (i < 0 || i >= (int) sizeof(vtkname))
+    ath_error("[flines_synth]: output name too long\n");
+
+  /* out.vtk -> out.seed.lis */
+  if (i > 4 && strcmp(vtkname + i-4, ".vtk") == 0)
+    i -= 4;
+  if (snprintf(seedname, sizeof(seedname), "%.*s.seed.lis", i, vtkname)
+      >= (int) sizeof(seedname))
+    ath_error("[flines_synth]: output name too long\n");
+
+  t = wall_time();
+  if ((fp = fopen(vtkname, "wb")) == NULL)
+    ath_error("[flines_synth]: could not open %s\n", vtkname);
+  synth_write(fp, name, n);
+  fclose(fp);
+
+  if ((fp = fopen(seedname, "w")) == NULL)
+    ath_error("[flines_synth]: could not open %s\n", seedname);
+  synth_seeds(fp, name, nseed);
+  fclose(fp);
+
+  printf("wrote %s (%.1f MB) and %s in %.2f s\n", vtkname,
+         12.0*n*n*(double) n/1048576.0, seedname, wall_time() - t);
+
+  return 0;
+}
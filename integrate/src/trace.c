@@ -0,0 +1,137 @@
+#include "trace.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int trace_on = 0;
+
+typedef struct Span_s{
+  const char *name;
+  double t0, t1;
+  int arg;
+}Span;
+
+typedef struct Ring_s{
+  Span *span;
+  unsigned long head;           /* total number of spans recorded */
+  char pad[64];
+}Ring;
+
+static Ring *rings = NULL;
+static int nrings, capacity;
+static double trace_t0;
+
+
+void trace_init(int nevents)
+{
+  int r;
+
+#ifdef _OPENMP
+  nrings = omp_get_max_threads();
+#else
+  nrings = 1;
+#endif
+
+  capacity = MAX(nevents, 1);
+  rings = (Ring*) calloc_1d_array(nrings, sizeof(Ring));
+  for (r=0; r<nrings; r++)
+    rings[r].span = (Span*) calloc_1d_array(capacity, sizeof(Span));
+
+  trace_t0 = wall_time();
+  trace_on = 1;
+
+  return;
+}
+
+
+void trace_free(void)
+{
+  int r;
+
+  if (rings == NULL)
+    return;
+
+  for (r=0; r<nrings; r++)
+    free_1d_array((void*) rings[r].span);
+  free_1d_array((void*) rings);
+
+  rings = NULL;
+  trace_on = 0;
+
+  return;
+}
+
+
+double trace_begin(void)
+{
+  return trace_on ? wall_time() : 0.0;
+}
+
+
+void trace_end(const char *name, double t0, int arg)
+{
+  Ring *ring;
+  Span *s;
+  int r = 0;
+
+  if (!trace_on)
+    return;
+
+#ifdef _OPENMP
+  r = omp_get_thread_num();
+  if (r >= nrings) return;
+#endif
+
+  ring = &rings[r];
+  s = &ring->span[ring->head % capacity];
+
+  s->name = name;
+  s->t0   = t0;
+  s->t1   = wall_time();
+  s->arg  = arg;
+
+  ring->head++;
+
+  return;
+}
+
+
+/* times are in microseconds since trace_init() */
+void trace_write(FILE *fp)
+{
+  int r, first = 1;
+  unsigned long n, start;
+  Span *s;
+
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+  for (r=0; r<nrings; r++) {
+    fprintf(fp, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            "\"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+            first ? "" : ",", r, r);
+    first = 0;
+
+    start = (rings[r].head > (unsigned long) capacity) ?
+      rings[r].head - capacity : 0;
+
+    for (n=start; n<rings[r].head; n++) {
+      s = &rings[r].span[n % capacity];
+
+      fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+              "\"ts\": %.3f, \"dur\": %.3f",
+              s->name, r, 1.0e6*(s->t0 - trace_t0), 1.0e6*(s->t1 - s->t0));
+      if (s->arg >= 0)
+        fprintf(fp, ", \"args\": {\"arg\": %d}", s->arg);
+      fprintf(fp, "}");
+    }
+
+    if (start > 0)
+      fprintf(stderr, "[trace_write]: thread %d dropped its first %lu spans\n",
+              r, start);
+  }
+
+  fprintf(fp, "\n]}\n");
+
+  return;
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "stats.h"
+
+/* timeline of what each thread was doing, written as Chrome
+   trace-event JSON (load it in chrome://tracing or ui.perfetto.dev).
+
+   each thread records spans into its own ring buffer, so recording
+   takes no locks; once a buffer is full the oldest spans are
+   overwritten.  when tracing is off, trace_begin() and trace_end()
+   return straight away.
+
+   usage:
+     double t0 = trace_begin();
+     ...
+     trace_end("vtkread", t0, -1);  */
+
+extern int trace_on;
+
+/* start tracing, keeping the last nevents spans of each thread */
+void trace_init(int nevents);
+void trace_free(void);
+
+double trace_begin(void);
+
+/* name must be a string constant.  arg (a line number, step count,
+   etc.) is shown with the span if it is >= 0 */
+void trace_end(const char *name, double t0, int arg);
+
+void trace_write(FILE *fp);
+
+#endif
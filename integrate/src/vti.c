@@ -0,0 +1,455 @@
+#include <math.h>
+#include "vti.h"
+#include "numa.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* compressed bytes read off the disk at a time */
+#define BATCH (64L << 20)
+
+/* raw arrays are cut into blocks of this many bytes, as if they were
+   compressed, so that they take the same path */
+#define RAW_BLOCK (1L << 20)
+
+/* the XML, up to the start of the appended data */
+#define MAXHEAD (1 << 20)
+
+/* how an array is laid out in the appended data */
+typedef struct Blocks_s{
+  long n;                       /* number of blocks */
+  long size;                    /* bytes per block, inflated... */
+  long last;                    /* ...and in the last one */
+  long *start;                  /* where each starts, from the first */
+  long *csize;                  /* bytes of each on disk */
+  int zlib;                     /* compressed, or as they are */
+}Blocks;
+
+/* what the header says */
+static int swap;                /* byte order isn't ours */
+static int header64;            /* UInt64 headers, not UInt32 */
+static int zlib;
+static long data_start;         /* where the appended data starts */
+
+
+/* the value of attribute name in the tag starting at tag, or NULL.
+   val gets at most len-1 characters. */
+static char *xml_attr(char *tag, char *name, char *val, int len)
+{
+  char *p, *end, key[64];
+  int n;
+
+  end = strchr(tag, '>');
+  sprintf(key, " %s=\"", name);
+  p = strstr(tag, key);
+  if (p == NULL || (end != NULL && p > end))
+    return NULL;
+
+  p += strlen(key);
+  for (n=0; n<len-1 && p[n] != '"' && p[n] != '\0'; n++)
+    val[n] = p[n];
+  val[n] = '\0';
+
+  return val;
+}
+
+
+/* read the XML, up to the "_" which starts the appended data */
+static char *xml_head(FILE *fp)
+{
+  char *head, *app;
+  int c, n = 0;
+
+  head = (char*) calloc_1d_array(MAXHEAD, sizeof(char));
+
+  app = NULL;
+  while ((c = fgetc(fp)) != EOF && n < MAXHEAD-1) {
+    head[n++] = c;
+    if (app == NULL && c == '>' &&
+        (app = strstr(head, "<AppendedData")) == NULL)
+      continue;
+    if (app != NULL && c == '_' && strchr(app, '>') != NULL)
+      break;
+  }
+  if (c != '_')
+    ath_error("[vtiread]: no appended data in the first %d bytes\n", n);
+  head[n] = '\0';
+  data_start = ftell(fp);
+
+  return head;
+}
+
+
+/* one header word, in our byte order */
+static long read_word(FILE *fp)
+{
+  unsigned char b[8], t;
+  unsigned int u32;
+  unsigned long u64;
+  int i, n = header64 ? 8 : 4;
+
+  if (fread(b, 1, n, fp) != (size_t) n)
+    ath_error("[vtiread]: Error reading an array header\n");
+  if (swap) {
+    for (i=0; i<n/2; i++) {
+      t = b[i];  b[i] = b[n-1-i];  b[n-1-i] = t;
+    }
+  }
+
+  if (header64) {
+    memcpy(&u64, b, 8);
+    return (long) u64;
+  }
+  memcpy(&u32, b, 4);
+  return (long) u32;
+}
+
+
+/* the blocks of the array at offset in the appended data */
+static void read_blocks(FILE *fp, long offset, long bytes, Blocks *bl)
+{
+  long b, at;
+
+  if (fseek(fp, data_start + offset, SEEK_SET) != 0)
+    ath_error("[vtiread]: Error seeking to an array\n");
+
+  bl->zlib = zlib;
+  if (zlib) {
+    bl->n    = read_word(fp);
+    bl->size = read_word(fp);
+    bl->last = read_word(fp);
+    if (bl->last == 0)
+      bl->last = bl->size;
+  } else {
+    if (read_word(fp) != bytes)
+      ath_error("[vtiread]: an array isn't the size of the grid\n");
+    bl->size = RAW_BLOCK;
+    bl->n = (bytes + RAW_BLOCK-1) / RAW_BLOCK;
+    bl->last = bytes - (bl->n-1)*RAW_BLOCK;
+  }
+  if (bl->n < 1 || (bl->n-1)*bl->size + bl->last != bytes)
+    ath_error("[vtiread]: an array isn't the size of the grid\n");
+
+  bl->start = (long*) calloc_1d_array(bl->n, sizeof(long));
+  bl->csize = (long*) calloc_1d_array(bl->n, sizeof(long));
+  for (b=0; b<bl->n; b++)
+    bl->csize[b] = zlib ? read_word(fp) : ((b == bl->n-1) ? bl->last : bl->size);
+
+  /* the blocks follow the header, one after the other */
+  at = ftell(fp);
+  for (b=0; b<bl->n; b++) {
+    bl->start[b] = at;
+    at += bl->csize[b];
+  }
+
+  return;
+}
+
+
+/* value n of the words at src, in our byte order: Float32... */
+static float get_float(unsigned char *src, long n)
+{
+  union Float_u dat;
+
+  memcpy(&dat.i, src + 4*n, 4);
+  if (swap) dat.i = Flip_int32(dat.i);
+
+  return dat.f;
+}
+
+
+/* ...or Float64 */
+static double get_double(unsigned char *src, long n)
+{
+  unsigned char b[8], t;
+  double d;
+  int i;
+
+  memcpy(b, src + 8*n, 8);
+  if (swap) {
+    for (i=0; i<4; i++) {
+      t = b[i];  b[i] = b[7-i];  b[7-i] = t;
+    }
+  }
+  memcpy(&d, b, 8);
+
+  return d;
+}
+
+
+/* put the nw words at src, which are words w0... of the array in the
+   file (ncomp to a cell), where they go in dst: doubles for vectors,
+   floats for scalars, over the cells of B.  whatever is outside the
+   roi is dropped.  this goes a row of the file at a time. */
+static void put_words(unsigned char *src, long w0, long nw, int word,
+                      int ncomp, void *dst)
+{
+  long w, end, row, lo, hi, out;
+  int j, k;
+
+  for (w=w0; w<w0+nw; w=end) {
+    row = w / ((long) ncomp*Nx_all);
+    end = MIN(w0+nw, (row+1)*ncomp*Nx_all);
+
+    j = (int) (row % Ny_all) - Joff;
+    k = (int) (row / Ny_all) - Koff;
+    if (j < 0 || j >= Ny || k < 0 || k >= Nz)
+      continue;
+
+    lo = MAX(w,   (row*Nx_all + Ioff)*ncomp);
+    hi = MIN(end, (row*Nx_all + Ioff + Nx)*ncomp);
+    out = (((long) k*Ny + j)*Nx)*ncomp - (row*Nx_all + Ioff)*ncomp;
+
+    if (ncomp == 3 && word == 4) {
+      for (; lo<hi; lo++)
+        ((double*) dst)[out + lo] = get_float(src, lo - w0);
+    } else if (ncomp == 3) {
+      for (; lo<hi; lo++)
+        ((double*) dst)[out + lo] = get_double(src, lo - w0);
+    } else if (word == 4) {
+      for (; lo<hi; lo++)
+        ((float*) dst)[out + lo] = get_float(src, lo - w0);
+    } else {
+      for (; lo<hi; lo++)
+        ((float*) dst)[out + lo] = get_double(src, lo - w0);
+    }
+  }
+
+  return;
+}
+
+
+/* the sum of the squares of the nw words at src */
+static double sum_words(unsigned char *src, long nw, int word)
+{
+  long w;
+  double s = 0.0;
+
+  if (word == 4) {
+    for (w=0; w<nw; w++)
+      s += SQR((double) get_float(src, w));
+  } else {
+    for (w=0; w<nw; w++)
+      s += SQR(get_double(src, w));
+  }
+
+  return s;
+}
+
+
+/* read one array into dst, word bytes to a value and ncomp values to
+   a cell.  with all, every block is read, and the sum of the squares
+   of the values over the whole file returned (for normalize_B() with
+   an roi, see ath_vtk.h); else only the blocks which hold B's cells,
+   and 0. */
+static double read_array(FILE *fp, char *name, long offset, int word,
+                         int ncomp, void *dst, int all)
+{
+  Blocks bl;
+  long b, b0, b1, bn, wlo, whi, bytes;
+  unsigned char *cbuf;
+  double *bsum, sum2;
+
+  bytes = (long) word*ncomp*Nx_all*Ny_all*Nz_all;
+  read_blocks(fp, offset, bytes, &bl);
+  if (bl.size % word != 0)
+    ath_error("[vtiread]: blocks of %ld bytes split the values of %s\n",
+              bl.size, name);
+#ifndef HAVE_ZLIB
+  if (bl.zlib)
+    ath_error("[vtiread]: %s is compressed; build flines with zlib\n", name);
+#endif
+
+  /* the words which hold B's cells, and the blocks they're in */
+  wlo = (((long) Koff*Ny_all + Joff)*Nx_all + Ioff)*ncomp;
+  whi = (((long) (Koff+Nz-1)*Ny_all + Joff+Ny-1)*Nx_all + Ioff+Nx)*ncomp;
+  b0 = wlo*word / bl.size;
+  b1 = (whi*word - 1) / bl.size + 1;
+
+  /* the sums go by block, and are added up in order after, so they
+     don't depend on the threads */
+  bsum = NULL;
+  if (all) {
+    b0 = 0;
+    b1 = bl.n;
+    bsum = (double*) calloc_1d_array(bl.n, sizeof(double));
+  }
+
+  cbuf = NULL;
+  for (; b0<b1; b0=bn) {
+    /* as many blocks as fit in a batch, but at least one */
+    for (bn=b0+1; bn<b1 &&
+           bl.start[bn] + bl.csize[bn] - bl.start[b0] <= BATCH; bn++)
+      ;
+
+    bytes = bl.start[bn-1] + bl.csize[bn-1] - bl.start[b0];
+    cbuf = (unsigned char*) realloc(cbuf, bytes);
+    if (cbuf == NULL)
+      ath_error("[vtiread]: failed to allocate %ld bytes\n", bytes);
+    if (fseek(fp, bl.start[b0], SEEK_SET) != 0 ||
+        fread(cbuf, 1, bytes, fp) != (size_t) bytes)
+      ath_error("[vtiread]: Error reading %s\n", name);
+
+#pragma omp parallel private(b)
+    {
+      unsigned char *src, *buf = NULL;
+      long n;
+#ifdef HAVE_ZLIB
+      uLongf len;
+
+      if (bl.zlib && (buf = (unsigned char*) malloc(bl.size)) == NULL)
+        ath_error("[vtiread]: failed to allocate %ld bytes\n", bl.size);
+#endif
+
+#pragma omp for schedule(dynamic)
+      for (b=b0; b<bn; b++) {
+        n = (b == bl.n-1) ? bl.last : bl.size;
+        src = cbuf + (bl.start[b] - bl.start[b0]);
+#ifdef HAVE_ZLIB
+        if (bl.zlib) {
+          len = n;
+          if (uncompress(buf, &len, src, bl.csize[b]) != Z_OK ||
+              len != (uLongf) n)
+            ath_error("[vtiread]: block %ld of %s is corrupt\n", b, name);
+          src = buf;
+        }
+#endif
+        put_words(src, b*bl.size/word, n/word, word, ncomp, dst);
+        if (all)
+          bsum[b] = sum_words(src, n/word, word);
+      }
+
+      free(buf);
+    }
+  }
+
+  sum2 = 0.0;
+  if (all) {
+    for (b=0; b<bl.n; b++)
+      sum2 += bsum[b];
+    free_1d_array((void*) bsum);
+  }
+
+  free(cbuf);
+  free_1d_array((void*) bl.start);
+  free_1d_array((void*) bl.csize);
+
+  return sum2;
+}
+
+
+void vtiread(FILE *fp)
+{
+  char *head, *tag, *cells, *end, val[256], name[128];
+  int c, n[3], ext[6], ncomp, word = 0;
+  double origin[3], spacing[3];
+  long offset;
+  void ***dum;
+  double sum2, rms;
+  int all;
+
+  if (nfield == 0)
+    vtk_fields("cell_centered_B");
+
+  head = xml_head(fp);
+
+  /* <VTKFile type="ImageData" byte_order=... header_type=...
+              compressor=...> */
+  tag = strstr(head, "<VTKFile");
+  if (tag == NULL || xml_attr(tag, "type", val, 256) == NULL ||
+      strcmp(val, "ImageData") != 0)
+    ath_error("[vtiread]: not a VTKFile of ImageData\n");
+
+  if (xml_attr(tag, "byte_order", val, 256) == NULL)
+    strcpy(val, "LittleEndian");
+  swap = (strcmp(val, "BigEndian") == 0) != is_big_endian();
+
+  header64 = (xml_attr(tag, "header_type", val, 256) != NULL &&
+              strcmp(val, "UInt64") == 0);
+
+  zlib = 0;
+  if (xml_attr(tag, "compressor", val, 256) != NULL) {
+    if (strcmp(val, "vtkZLibDataCompressor") != 0)
+      ath_error("[vtiread]: can't read data compressed with %s\n", val);
+    zlib = 1;
+  }
+
+  /* <ImageData WholeExtent=... Origin=... Spacing=...> */
+  tag = strstr(head, "<ImageData");
+  if (tag == NULL ||
+      xml_attr(tag, "WholeExtent", val, 256) == NULL ||
+      sscanf(val, "%d %d %d %d %d %d",
+             &ext[0], &ext[1], &ext[2], &ext[3], &ext[4], &ext[5]) != 6 ||
+      xml_attr(tag, "Origin", val, 256) == NULL ||
+      sscanf(val, "%le %le %le", &origin[0], &origin[1], &origin[2]) != 3 ||
+      xml_attr(tag, "Spacing", val, 256) == NULL ||
+      sscanf(val, "%le %le %le", &spacing[0], &spacing[1], &spacing[2]) != 3)
+    ath_error("[vtiread]: can't make out the ImageData tag\n");
+
+  tag = strstr(head, "<Piece");
+  if (tag == NULL || strstr(tag+1, "<Piece") != NULL)
+    ath_error("[vtiread]: only files of one piece are read\n");
+
+  tag = strstr(head, "<AppendedData");
+  if (xml_attr(tag, "encoding", val, 256) == NULL || strcmp(val, "raw") != 0)
+    ath_error("[vtiread]: only raw appended data is read, not %s\n", val);
+
+  /* the grid, as vtkread() has it: cells, and the first corner */
+  for (c=0; c<3; c++) {
+    n[c] = MAX(ext[2*c+1] - ext[2*c], 1);
+    origin[c] += ext[2*c]*spacing[c];
+  }
+  vtk_grid(n, origin, spacing);
+
+  /* the arrays wanted, from the CellData */
+  cells = strstr(head, "<CellData");
+  end = (cells != NULL) ? strstr(cells, "</CellData>") : NULL;
+  for (tag = cells; tag != NULL && end != NULL &&
+         (tag = strstr(tag+1, "<DataArray")) != NULL && tag < end; ) {
+    if (xml_attr(tag, "Name", name, 128) == NULL)
+      ath_error("[vtiread]: a DataArray without a Name\n");
+
+    ncomp = (xml_attr(tag, "NumberOfComponents", val, 256) != NULL) ?
+      atoi(val) : 1;
+    if ((ncomp != 1 && ncomp != 3) || !vtk_wanted(name, ncomp == 3))
+      continue;
+
+    if (xml_attr(tag, "type", val, 256) == NULL)
+      strcpy(val, "no type");
+    if (strcmp(val, "Float32") == 0)
+      word = 4;
+    else if (strcmp(val, "Float64") == 0)
+      word = 8;
+    else
+      ath_error("[vtiread]: %s is %s; only Float32 and Float64 are read\n",
+                name, val);
+
+    if (xml_attr(tag, "format", val, 256) == NULL ||
+        strcmp(val, "appended") != 0 ||
+        xml_attr(tag, "offset", val, 256) == NULL)
+      ath_error("[vtiread]: %s isn't in the appended data\n", name);
+    offset = atol(val);
+
+    if (ncomp == 3)
+      dum = calloc_3d_array_numa(Nz, Ny, Nx, sizeof(Real3Vect));
+    else
+      dum = calloc_3d_array_numa(Nz, Ny, Nx, sizeof(float));
+    /* vectors cut down to an roi need their rms over the whole box,
+       unless it was given */
+    rms = (ncomp == 3) ? vtk_given_rms(name) : 0.0;
+    all = (ncomp == 3 && roi_cut && rms == 0.0);
+    sum2 = read_array(fp, name, offset, word, ncomp, (void*) dum[0][0], all);
+    if (all) {
+      rms = sqrt(sum2 / ((double) Nx_all*Ny_all*Nz_all));
+      vtk_found_rms(name, rms);
+    }
+    vtk_keep(name, ncomp == 3, dum, rms);
+  }
+
+  free_1d_array((void*) head);
+
+  vtk_check("vtiread");
+
+  return;
+}
@@ -0,0 +1,34 @@
+#ifndef VTI_H
+#define VTI_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "ath_vtk.h"
+
+/* XML ImageData (.vti) files, as newer runs write them to save disk.
+
+   only what athena and vtkXMLImageDataWriter write with appended raw
+   data is read: one piece covering the whole extent, CellData arrays
+   of Float32 or Float64 (1 component for scalars, 3 for vectors),
+   either as they are or compressed with vtkZLibDataCompressor, in
+   either byte order, with UInt32 or UInt64 headers.  base64 data and
+   other compressors are refused.
+
+   a compressed array is a list of blocks (32 kB each, as VTK writes
+   them) which can be inflated independently.  they're read off the
+   disk a batch at a time, then every thread takes blocks and inflates
+   each one straight into its place in the field.  with an roi (see
+   ath_vtk.h), blocks which hold none of it aren't read, unless the
+   rms of a vector array over the whole box has to be worked out.
+   arrays which aren't wanted are never touched.
+
+   compressed files need zlib: build with it (the default) or the
+   reader says so and stops. */
+void vtiread(FILE *fp);
+
+#endif
@@ -0,0 +1,150 @@
+#include <pthread.h>
+#include "writer.h"
+#include "stats.h"
+
+/* a finished line, trimmed to the points it has */
+typedef struct Line_s{
+  int npts;
+  Real3Vect *x;
+  float **attr;                 /* nattr by npts, or NULL */
+}Line;
+
+static FILE *outfile;
+static Line **slot = NULL;      /* the reorder buffer: slot[n] is line n */
+static int next;                /* the line the writer wants next */
+static double busy;             /* time spent writing */
+static long nout;               /* points written */
+
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+
+
+/* the lock and condition variable are only for the writer to sleep
+   on; the lines themselves are passed through slot[] */
+static Line *writer_wait(int n)
+{
+  Line *l;
+
+  l = __atomic_load_n(&slot[n], __ATOMIC_ACQUIRE);
+  if (l != NULL)
+    return l;
+
+  pthread_mutex_lock(&lock);
+  while ((l = __atomic_load_n(&slot[n], __ATOMIC_ACQUIRE)) == NULL)
+    pthread_cond_wait(&ready, &lock);
+  pthread_mutex_unlock(&lock);
+
+  return l;
+}
+
+
+static void *writer_main(void *arg)
+{
+  Line *l;
+  int *keep, n;
+  double t;
+
+  (void) arg;
+  keep = (int*) calloc_1d_array(maxstep, sizeof(int));
+
+  for (next=0; next<nlines; next++) {
+    l = writer_wait(next);
+
+    t = wall_time();
+    n = simplify_line(l->x, l->npts, keep);
+    print_line(outfile, l->x, l->attr, keep, n);
+    nout += n;
+    fflush(outfile);
+    busy += wall_time() - t;
+
+    free_1d_array((void*) l->x);
+    if (l->attr != NULL)
+      free_2d_array((void**) l->attr);
+    free_1d_array((void*) l);
+    slot[next] = NULL;
+  }
+
+  free_1d_array((void*) keep);
+
+  return NULL;
+}
+
+
+void writer_open(char *outfname)
+{
+  int a;
+
+  if ((outfile = fopen(outfname, "w")) == NULL)
+    ath_error("[writer_open]: could not open %s\n", outfname);
+
+  if (nattr > 0) {
+    fprintf(outfile, "# x y z");
+    for (a=0; a<nattr; a++)
+      fprintf(outfile, " %s", attr_name[a]);
+    fprintf(outfile, "\n");
+  }
+
+  slot = (Line**) calloc_1d_array(MAX(nlines, 1), sizeof(Line*));
+  busy = 0.0;
+  nout = 0;
+
+  if (pthread_create(&thread, NULL, writer_main, NULL) != 0)
+    ath_error("[writer_open]: could not start the writer thread\n");
+
+  return;
+}
+
+
+void writer_put(int line, Real3Vect *xvals, float **attr)
+{
+  Line *l;
+  int first, last, j, a;
+
+  /* only keep the part of the line that was integrated */
+  for (first=0; first<maxstep && xvals[first].x1 == -1.0; first++) ;
+  for (last=maxstep-1; last>first && xvals[last].x1 == -1.0; last--) ;
+  if (first == maxstep)
+    first = last = 0;
+
+  l = (Line*) calloc_1d_array(1, sizeof(Line));
+  l->npts = last - first + 1;
+  l->x = (Real3Vect*) calloc_1d_array(l->npts, sizeof(Real3Vect));
+  for (j=first; j<=last; j++)
+    l->x[j-first] = xvals[j];
+
+  l->attr = NULL;
+  if (attr != NULL) {
+    l->attr = (float**) calloc_2d_array(nattr, l->npts, sizeof(float));
+    for (a=0; a<nattr; a++)
+      for (j=first; j<=last; j++)
+        l->attr[a][j-first] = attr[a][j];
+  }
+
+  /* publish it, and wake the writer in case this is the line it's
+     waiting for */
+  __atomic_store_n(&slot[line], l, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&lock);
+  pthread_cond_signal(&ready);
+  pthread_mutex_unlock(&lock);
+
+  return;
+}
+
+
+double writer_close(void)
+{
+  pthread_join(thread, NULL);
+
+  fprintf(outfile, "\n");
+  fclose(outfile);
+
+  if (simplify > 0.0)
+    printf("simplify: wrote %ld points\n", nout);
+
+  free_1d_array((void*) slot);
+  slot = NULL;
+
+  return busy;
+}
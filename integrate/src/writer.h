@@ -0,0 +1,39 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defs.h"
+#include "ath_array.h"
+#include "ath_error.h"
+#include "lines.h"
+
+/* write lines as they are finished, instead of holding all of them
+   in xvals until the end.
+
+   a writer thread owns the output file.  the threads tracing lines
+   hand each one over with writer_put(), which trims it to the points
+   it has and publishes it in the line's slot of a reorder buffer (one
+   slot per line, so no two threads ever touch the same one and the
+   hand-off needs no lock).  the writer takes the slots in seed order,
+   waiting when the next line isn't ready yet, writes each exactly as
+   write_data() would, and frees it.  so the file comes out the same as
+   before, memory only holds the lines which are in progress or
+   waiting on an earlier one, the writing overlaps the tracing, and a
+   run which is stopped early leaves a file with the lines up to
+   where the writer got. */
+
+/* start writing outfname.  attributes are written when nattr > 0. */
+void writer_open(char *outfname);
+
+/* line n is done.  the writer keeps a copy of the points of xvals
+   (maxstep of them) which were traced, and of attr (nattr by maxstep,
+   or NULL), so the caller can reuse them right away. */
+void writer_put(int line, Real3Vect *xvals, float **attr);
+
+/* wait until every line has been written, and close the file.
+   returns the time the writer spent writing. */
+double writer_close(void);
+
+#endif
@@ -9,6 +9,14 @@
 #
 # Note that this does *not* work with SMR.
 #
+# Pass a comma-separated list of array names (eg,
+# cell_centered_B,specific_scalar[0]) to join only those; see
+# join_vtk.x -f.
+#
+# With -l 2,4 the merged files also get copies reduced 2x and 4x,
+# merged/*.lod2.vtk and so on, for quick looks with flines (see
+# files/lod in input.fline, and mk-flines.rb -l).
+#
 require 'fileutils'
 
 def issue_cmd(cmd)
@@ -33,6 +41,15 @@ end
 
 issue_cmd 'mkdir -p merged'
 
+lods = []
+if (i = ARGV.index('-l'))
+  lods = ARGV[i+1].split(',').map{|f| f.to_i}
+  ARGV.slice!(i, 2)
+end
+
+fields = ARGV[0] ? "-f '#{ARGV[0]}' " : ''
+lod    = lods.empty? ? '' : "-l #{lods.join(',')} "
+
 dirs  = Dir.glob('id[^0]*').map{|f| f.sub(/^id/, '')}
 files = Dir.glob('id0/*.vtk').map{|f| strip_digits(f)}
 base  = get_base(Dir.glob('id0/*.vtk').first)
@@ -43,10 +60,12 @@ files.each do |num|
   infiles = ["id0/#{base}.#{num}.vtk"]
   infiles = infiles + dirs.map{|d| "id#{d}/#{base}-id#{d}.#{num}.vtk"}
 
-  unless FileUtils.uptodate?(outfile, infiles)
+  outfiles = [outfile] + lods.map{|f| outfile.sub(/\.vtk$/, ".lod#{f}.vtk")}
+
+  unless outfiles.all?{|f| FileUtils.uptodate?(f, infiles)}
     puts "writing #{outfile}..."
     str = infiles.join(" ")
-    cmd = "./join_vtk.x -o #{outfile} " + str + '>& /dev/null'
+    cmd = "./join_vtk.x -o #{outfile} " + fields + lod + str + '>& /dev/null'
     issue_cmd cmd
   end
 end
@@ -19,6 +19,17 @@
 #    instead, I write a shell script with the calls and pipe that into
 #    gnu parallel.
 #
+# 6. with -c, each snapshot also writes base.dddd.flines.cache and
+#    reads the one before it, so that lines which only pass through
+#    parts of the box that haven't changed are copied rather than
+#    traced again (see integrate/src/cache.h).  the snapshots then
+#    have to run one after another, in order; each one still uses
+#    all of its threads.
+#
+# 7. with -l N, the copies reduced N times (base.dddd.lodN.vtk, see
+#    join-vtk.rb -l) are used instead, for a quick look; the lines go
+#    to base.dddd.lodN.flines.
+#
 #
 # TODO:
 #
@@ -41,12 +52,17 @@ end
 
 
 # command to run flines once
+# - cache_in and cache_out are only given with -c
 #
-def flines_cmd(vtkfile, seedfile, outfile)
+def flines_cmd(vtkfile, seedfile, outfile, cache_in = nil, cache_out = nil,
+               lod = 1)
   str = "./flines -i input.fline"
   str += " files/vtk_file=#{vtkfile}"
+  str += " files/lod=#{lod}"             if lod > 1
   str += " files/out_file=#{outfile}"
   str += " initial_condition/seed_file=#{seedfile}"
+  str += " files/cache_in=#{cache_in}"   if cache_in
+  str += " files/cache_out=#{cache_out}" if cache_out
 
   return str
 end
@@ -112,26 +128,43 @@ unless File.readable?('./input.fline')
   exit 1
 end
 
+# reuse lines from the previous snapshot?
+incremental = ARGV.include?('-c')
+
+# quick look at a reduced copy?
+lod = (i = ARGV.index('-l')) ? ARGV[i+1].to_i : 1
+suffix = lod > 1 ? ".lod#{lod}" : ''
+
 # get the basename
-base = get_base(Dir.glob('*.vtk').first)
+base = get_base(Dir.glob('*.[0-9][0-9][0-9][0-9].vtk').first)
 
 
 # get pairs of vtk and seed files
-vtk_files  = Dir.glob('*.vtk').map{|f| strip_digits(f)}
+vtk_files  = Dir.glob("*.[0-9][0-9][0-9][0-9]#{suffix}.vtk").map{|f| strip_digits(f)}
 seed_files = Dir.glob('*.lis').map{|f| strip_digits(f)}
-nums = vtk_files & seed_files   # & means 'intersect'
+nums = (vtk_files & seed_files).sort   # & means 'intersect'
 
 
 # build a list of commands to update field line files
 cmds = []
+prev_cache = nil
 nums.each do |num|
   vtkfile  = "#{base}.#{num}.vtk"
   seedfile = "#{base}.#{num}.seed.lis"
-  outfile  = "#{base}.#{num}.flines"
+  outfile  = "#{base}.#{num}#{suffix}.flines"
+  cache    = incremental ? "#{outfile}.cache" : nil
+
+  # once one snapshot is redone, everything after it has a new cache
+  # to read, so it's redone too
+  deps = ["#{base}.#{num}#{suffix}.vtk", seedfile]
+  deps << prev_cache if prev_cache && File.exist?(prev_cache)
 
-  unless FileUtils.uptodate?(outfile, [vtkfile, seedfile])
-    cmds << flines_cmd(vtkfile, seedfile, outfile)
+  if !FileUtils.uptodate?(outfile, deps) ||
+      (incremental && (!cmds.empty? || !File.exist?(cache)))
+    cmds << flines_cmd(vtkfile, seedfile, outfile, prev_cache, cache, lod)
   end
+
+  prev_cache = cache
 end
 
 if cmds.empty?
@@ -141,7 +174,7 @@ end
 
 puts "running #{cmds.length} files..."
 
-if command?('parallel')
+if command?('parallel') && !incremental
   pipe_to_parallel(cmds)
 else
   cmds.each do |cmd|
@@ -0,0 +1,193 @@
+# scaling.rb: time whole runs of `flines' on synthetic fields
+#
+# NOTES:
+#
+# 1. Run it in a directory with `flines', `flines_synth' and an
+#    `input.fline' (make puts the first two in bin/).  Every run uses
+#    that input file, with the field, seeds, line count and output
+#    names overridden on the command line, as mk-flines.rb does.
+#
+# 2. The fields and their seed files are made once, by flines_synth,
+#    in scaling/ (eg, scaling/tangled.0256.vtk), and kept for next
+#    time.  1024^3 is 12 GB on disk, and flines holds it as doubles.
+#
+# 3. For every grid size, every line count is run with every thread
+#    count (strong scaling: the same work on more threads), and then
+#    the smallest line count times the threads is run on each thread
+#    count (weak scaling: the same work per thread).  Wall time is
+#    taken around the whole run; peak RSS and the time spent tracing
+#    come from the stats file flines writes.
+#
+# 4. The tables are printed, and every run goes to scaling.json.
+#
+# USAGE: ruby scaling.rb [-f tangled] [-s 64,128,256] [-l 1000,4000]
+#                        [-t 1,2,4] [-r 1] [-o scaling.json]
+#
+require 'json'
+require 'fileutils'
+
+# isolate the call to system() for debugging.
+#
+def issue_cmd(cmd)
+  system cmd
+end
+
+
+def list_arg(flag, default)
+  i = ARGV.index(flag)
+  i ? ARGV[i+1].split(',').map{|v| v.to_i} : default
+end
+
+
+def str_arg(flag, default)
+  i = ARGV.index(flag)
+  i ? ARGV[i+1] : default
+end
+
+
+# one run of flines; the best of reps wall times, with the stats of
+# that run
+#
+def run_flines(vtkfile, seedfile, nlines, threads, reps)
+  base  = "scaling/run"
+  best  = nil
+
+  reps.times do
+    cmd  = "OMP_NUM_THREADS=#{threads} ./flines -i input.fline"
+    cmd += " files/vtk_file=#{vtkfile}"
+    cmd += " files/out_file=#{base}.flines"
+    cmd += " files/stats_file=#{base}.json"
+    cmd += " initial_condition/seed_file=#{seedfile}"
+    cmd += " initial_condition/n_seed=#{nlines}"
+    cmd += " integration/n_lines=#{nlines}"
+    cmd += " > #{base}.log 2>&1"
+
+    t0 = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    unless issue_cmd(cmd)
+      puts "###error: flines failed; see #{base}.log"
+      exit 1
+    end
+    wall = Process.clock_gettime(Process::CLOCK_MONOTONIC) - t0
+
+    stats = JSON.parse(File.read("#{base}.json"))
+    if best.nil? || wall < best['wall']
+      best = {'wall'      => wall,
+              'integrate' => stats['phases']['integrate'],
+              'load'      => stats['phases']['load'],
+              'rss_mb'    => stats['peak_rss_kb'] / 1024.0}
+    end
+  end
+
+  return best
+end
+
+
+# the speedup and efficiency of each run over the one on the fewest
+# threads, on the same work (strong) or the same work per thread
+# (weak)
+#
+def scaling(runs, weak)
+  t1 = runs.first
+  runs.map do |r|
+    speedup = t1['wall'] / r['wall']
+    ratio   = r['threads'].to_f / t1['threads']
+    r.merge('speedup'    => weak ? speedup * ratio : speedup,
+            'efficiency' => weak ? speedup : speedup / ratio)
+  end
+end
+
+
+def print_table(title, runs)
+  puts
+  puts title
+  puts "  threads    lines     wall(s)  integrate(s)  rss(MB)  speedup  efficiency"
+  runs.each do |r|
+    printf("  %7d  %7d  %10.3f  %12.3f  %7.1f  %7.2f  %10.2f\n",
+           r['threads'], r['lines'], r['wall'], r['integrate'], r['rss_mb'],
+           r['speedup'], r['efficiency'])
+  end
+end
+
+
+################################################################################
+
+# <program>
+
+['./flines', './flines_synth'].each do |exe|
+  unless File.executable?(exe)
+    puts "###error: #{exe} not found"
+    exit 1
+  end
+end
+
+unless File.readable?('./input.fline')
+  puts "###error: input.fline not found"
+  exit 1
+end
+
+field   = str_arg('-f', 'tangled')
+sizes   = list_arg('-s', [64, 128, 256])
+lines   = list_arg('-l', [1000, 4000])
+threads = list_arg('-t', [1, 2, 4])
+reps    = list_arg('-r', [1]).first
+outfile = str_arg('-o', 'scaling.json')
+
+FileUtils.mkdir_p('scaling')
+
+# enough seeds for the biggest weak scaling run
+nseed = [lines.max, lines.min * threads.max].max
+
+results = {'field' => field, 'sizes' => []}
+
+sizes.each do |n|
+  base     = format("scaling/%s.%04d", field, n)
+  vtkfile  = "#{base}.vtk"
+  seedfile = "#{base}.seed.lis"
+
+  unless File.exist?(vtkfile) && File.exist?(seedfile) &&
+      File.readlines(seedfile).length > nseed
+    issue_cmd "./flines_synth -f #{field} -n #{n} -s #{nseed} -o #{vtkfile}"
+  end
+
+  entry = {'n' => n, 'strong' => [], 'weak' => nil}
+
+  lines.each do |nl|
+    runs = threads.map do |t|
+      puts "n = #{n}, #{nl} lines, #{t} threads..."
+      {'threads' => t, 'lines' => nl}.merge(run_flines(vtkfile, seedfile, nl, t, reps))
+    end
+    runs = scaling(runs, false)
+    entry['strong'] << runs
+    print_table("strong scaling: #{field} #{n}^3, #{nl} lines", runs)
+  end
+
+  runs = threads.map do |t|
+    nl = lines.min * t / threads.min
+    puts "n = #{n}, #{nl} lines, #{t} threads..."
+    {'threads' => t, 'lines' => nl}.merge(run_flines(vtkfile, seedfile, nl, t, reps))
+  end
+  entry['weak'] = scaling(runs, true)
+  print_table("weak scaling: #{field} #{n}^3, #{lines.min / threads.min} lines per thread",
+              entry['weak'])
+
+  results['sizes'] << entry
+end
+
+# how the run with the fewest lines and threads grows with the grid
+puts
+puts "grid size: #{lines.min} lines, #{threads.min} threads"
+puts "     n     wall(s)     load(s)  integrate(s)  rss(MB)"
+results['sizes'].each do |e|
+  r = e['strong'].first.first
+  printf("  %4d  %10.3f  %10.3f  %12.3f  %7.1f\n",
+         e['n'], r['wall'], r['load'], r['integrate'], r['rss_mb'])
+end
+
+File.write(outfile, JSON.pretty_generate(results))
+puts
+puts "wrote #{outfile}"
+
+# </program>
+
+
+exit 0
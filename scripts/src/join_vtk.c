@@ -8,7 +8,15 @@
  *
  * COMPILE USING: gcc -Wall -W -o join_vtk join_vtk.c -lm
  *
- * USAGE: ./join_vtk -o <outfile.vtk> infile1.vtk infile2.vtk ...
+ * USAGE: ./join_vtk -o <outfile.vtk> [-f name1,name2,...] [-l 2,4,...]
+ *                   infile1.vtk ...
+ *
+ *   with -f, only the named arrays are joined; the rest are skipped
+ *   over in every file without being read.
+ *
+ *   with -l, copies reduced by each factor are written as well, to
+ *   <outfile>.lod2.vtk and so on: every cell of the copy is the mean
+ *   of the factor^3 cells it covers (fewer at the far edges).
  *
  * WRITTEN BY: Tom Gardiner, November 2004
  *============================================================================*/
@@ -37,11 +45,24 @@
    that happen to correspond to "white space" from being consumed by
    fscanf().  -- Nicole Lemaster -- Feb. 16, 2006 */
 
+/* Added -f to join only some of the arrays.  flines wants
+   cell_centered_B and perhaps specific_scalar[0], about a fifth of
+   what athena writes; the others are stepped over with fseek(), so
+   the reads land only on what is kept. */
+
+/* Added -l to write box-filtered copies in the same pass, for quick
+   looks (see files/lod in flines).  each keeps a plane of sums per
+   array, which is written out every factor planes, so nothing else is
+   held in memory. */
+
 
 static void join_error(const char *fmt, ...);
 static void init_domain_1d(void);
 static void sort_domain_1d(void);
 static void write_joined_vtk(const char *out_name);
+static void parse_fields(const char *list);
+static void parse_lod(const char *list);
+static int keep_array(const char *variable);
 static char *my_strdup(const char *in);
 static void free_3d_array(void ***array);
 static void*** calloc_3d_array(size_t nt, size_t nr, size_t nc, size_t size);
@@ -65,6 +86,20 @@ static VTK_Domain *domain_1d;
 static int NGrid_x, NGrid_y, NGrid_z;
 static VTK_Domain ***domain_3d=NULL;
 
+/* The arrays to join, from -f.  nkeep = 0 joins them all. */
+static int nkeep = 0;
+static char **keep = NULL;
+static int *kept = NULL; /* how often each was found */
+
+/* The reduced copies, from -l */
+#define MAX_LOD 8
+static int nlod = 0;
+static int lod_factor[MAX_LOD];
+static FILE *lod_fp[MAX_LOD];
+static int lod_nx[MAX_LOD], lod_ny[MAX_LOD], lod_nz[MAX_LOD];
+static double *lod_sum[MAX_LOD]; /* one plane of the copy, 3 per cell */
+static int nx_all, ny_all, nz_all; /* the size of the joined grid */
+
 
 /* ========================================================================== */
 
@@ -87,23 +122,35 @@ int main(int argc, char* argv[]){
 
 
   if(argc < 5)
-    join_error("Usage: %s -o <out_name.vtk> file1.vtk file2.vtk ...\n",argv[0]);
+    join_error("Usage: %s -o <out_name.vtk> [-f name1,name2,...] "
+               "[-l 2,4,...] file1.vtk file2.vtk ...\n",argv[0]);
 
-  file_count = argc-3; /* Number of input vtk files */
+  file_count = argc-1; /* Number of input vtk files, less the options */
 
-  /* Parse the command line for the output filename */
+  /* Parse the command line for the output filename and the arrays */
   for(i=1; i<argc-1; i++){
     if(strcmp(argv[i],"-o") == 0){
       i++; /* increment to the filename */
       if((out_name = my_strdup(argv[i])) == NULL)
         join_error("out_name = my_strdup(\"%s\") failed\n",argv[i]);
-      break;
+      file_count -= 2;
+    }
+    else if(strcmp(argv[i],"-f") == 0){
+      i++; /* increment to the list */
+      parse_fields(argv[i]);
+      file_count -= 2;
+    }
+    else if(strcmp(argv[i],"-l") == 0){
+      i++; /* increment to the list */
+      parse_lod(argv[i]);
+      file_count -= 2;
     }
   }
 
   /* An output filename is required */
-  if(out_name == NULL)
-    join_error("Usage: %s -o <out_name.vtk> file1.vtk file2.vtk ...\n",argv[0]);
+  if(out_name == NULL || file_count < 1)
+    join_error("Usage: %s -o <out_name.vtk> [-f name1,name2,...] "
+               "[-l 2,4,...] file1.vtk file2.vtk ...\n",argv[0]);
 
   printf("Output filename is \"%s\"\n",out_name);
   printf("Found %d files on the command line\n",file_count);
@@ -116,8 +163,9 @@ int main(int argc, char* argv[]){
 
   /* Populate the 1d domain array with the filenames */
   for(n=0, i=1; i<argc; i++){
-    if(strcmp(argv[i],"-o") == 0){
-      i++; /* increment to the filename */
+    if(strcmp(argv[i],"-o") == 0 || strcmp(argv[i],"-f") == 0 ||
+       strcmp(argv[i],"-l") == 0){
+      i++; /* increment to the filename or list */
     }
     else{
       if((domain_1d[n].fname = my_strdup(argv[i])) == NULL){
@@ -192,6 +240,14 @@ int main(int argc, char* argv[]){
   free(out_name);
   out_name = NULL;
 
+  for(i=0; i<nkeep; i++)
+    free(keep[i]);
+  free(keep);
+  free(kept);
+
+  for(i=0; i<nlod; i++)
+    free(lod_sum[i]);
+
   return(0) ;
 }
 
@@ -420,18 +476,193 @@ static void sort_domain_1d(void){
 /* ========================================================================== */
 
 
+/* Write the header of a joined file of nx*ny*nz cells */
+static void write_header(FILE *fp, const char *comment, int nx, int ny, int nz,
+                         double ox, double oy, double oz,
+                         double dx, double dy, double dz){
+  int nxp, nyp, nzp;
+
+  /* Count the number of grid cell corners */
+  if(nx >= 1 && dx > 0.0) nxp = nx+1;
+  else nxp = nx; /* dx = 0.0 */
+
+  if(ny >= 1 && dy > 0.0) nyp = ny+1;
+  else nyp = ny; /* dy = 0.0 */
+
+  if(nz >= 1 && dz > 0.0) nzp = nz+1;
+  else nzp = nz; /* dz = 0.0 */
+
+  fprintf(fp,"# vtk DataFile Version 3.0\n");
+  fprintf(fp,"%s\n",comment);
+  fprintf(fp,"BINARY\n");
+  fprintf(fp,"DATASET STRUCTURED_POINTS\n");
+  fprintf(fp,"DIMENSIONS %d %d %d\n", nxp, nyp, nzp);
+  fprintf(fp,"ORIGIN %e %e %e\n", ox, oy, oz);
+  fprintf(fp,"SPACING %e %e %e\n", dx, dy, dz);
+  fprintf(fp,"CELL_DATA %d\n",nx*ny*nz);
+
+  return;
+}
+
+
+/* ========================================================================== */
+
+
+/* VTK binary data are big-endian; swap n floats to or from this
+   machine's order */
+static void swap_big_endian(float *v, int n){
+  static const int one = 1;
+  unsigned char *c, t;
+  int m;
+
+  if(*(const char *)&one == 0) return; /* big-endian already */
+
+  for(m=0; m<n; m++){
+    c = (unsigned char *)&v[m];
+    t = c[0]; c[0] = c[3]; c[3] = t;
+    t = c[1]; c[1] = c[2]; c[2] = t;
+  }
+
+  return;
+}
+
+
+/* The name of the copy reduced by f: out.vtk -> out.lod<f>.vtk */
+static char *lod_name(const char *out_name, int f){
+  char *name;
+  size_t n = strlen(out_name);
+
+  if((name = (char *)malloc(n+32)) == NULL)
+    join_error("lod_name: failed to allocate %d\n",(int)(n+32));
+
+  if(n > 4 && strcmp(out_name+n-4, ".vtk") == 0)
+    sprintf(name, "%.*s.lod%d.vtk", (int)(n-4), out_name, f);
+  else
+    sprintf(name, "%s.lod%d.vtk", out_name, f);
+
+  return name;
+}
+
+
+/* Open the reduced copies of a joined grid of nx*ny*nz cells, and
+   write their headers */
+static void lod_open(const char *out_name, const char *comment,
+                     int nx, int ny, int nz, double ox, double oy, double oz,
+                     double dx, double dy, double dz){
+  char *name;
+  int l, f;
+
+  nx_all = nx;  ny_all = ny;  nz_all = nz;
+
+  for(l=0; l<nlod; l++){
+    f = lod_factor[l];
+    lod_nx[l] = (nx + f-1)/f;
+    lod_ny[l] = (ny + f-1)/f;
+    lod_nz[l] = (nz + f-1)/f;
+
+    lod_sum[l] = (double *)calloc(3*lod_nx[l]*lod_ny[l], sizeof(double));
+    if(lod_sum[l] == NULL)
+      join_error("lod_open: failed to allocate a plane of %d x %d\n",
+                 lod_nx[l], lod_ny[l]);
+
+    name = lod_name(out_name, f);
+    if((lod_fp[l] = fopen(name,"w")) == NULL)
+      join_error("Error opening the output file \"%s\"\n",name);
+    printf("Reduced by %d: \"%s\"\n",f,name);
+    free(name);
+
+    write_header(lod_fp[l], comment, lod_nx[l], lod_ny[l], lod_nz[l],
+                 ox, oy, oz, f*dx, f*dy, f*dz);
+  }
+
+  return;
+}
+
+
+/* Start an array in every reduced copy */
+static void lod_array(const char *type, const char *variable,
+                      const char *format){
+  int l;
+
+  for(l=0; l<nlod; l++){
+    fprintf(lod_fp[l],"%s %s %s\n",type,variable,format);
+    if(strcmp(type, "SCALARS") == 0)
+      fprintf(lod_fp[l],"LOOKUP_TABLE default\n");
+  }
+
+  return;
+}
+
+
+/* Add cell (i,j) of the current plane, ncomp floats as read, into
+   the plane of sums of every reduced copy */
+static void lod_add(int i, int j, const float *v, int ncomp){
+  float w[3];
+  double *sum;
+  int l, c;
+
+  memcpy(w, v, ncomp*sizeof(float));
+  swap_big_endian(w, ncomp);
+
+  for(l=0; l<nlod; l++){
+    sum = &lod_sum[l][3*((j/lod_factor[l])*lod_nx[l] + i/lod_factor[l])];
+    for(c=0; c<ncomp; c++)
+      sum[c] += w[c];
+  }
+
+  return;
+}
+
+
+/* Plane k of the joined grid is done: write out the plane of each
+   reduced copy which it finishes, and start that one again */
+static void lod_plane(int k, int ncomp){
+  float w[3];
+  double *sum;
+  int l, f, i, j, c, n, ni, nj, nk;
+
+  for(l=0; l<nlod; l++){
+    f = lod_factor[l];
+    if((k+1) % f != 0 && k != nz_all-1) continue;
+
+    nk = k%f + 1; /* planes in this one */
+    for(j=0; j<lod_ny[l]; j++){
+      nj = (ny_all - j*f < f) ? ny_all - j*f : f;
+      for(i=0; i<lod_nx[l]; i++){
+        ni = (nx_all - i*f < f) ? nx_all - i*f : f;
+        n = ni*nj*nk;
+
+        sum = &lod_sum[l][3*(j*lod_nx[l] + i)];
+        for(c=0; c<ncomp; c++){
+          w[c] = sum[c]/n;
+          sum[c] = 0.0;
+        }
+        swap_big_endian(w, ncomp);
+        fwrite(w, sizeof(float), ncomp, lod_fp[l]);
+      }
+    }
+  }
+
+  return;
+}
+
+
+/* ========================================================================== */
+
+
 static void read_write_scalar(FILE *fp_out){
 
   FILE *fp;
   int i, j, k, ig, jg, kg, nread;
+  int ia, ja, ka; /* i, j, k in the joined grid */
   float fdat;
 
-  for(kg=0; kg<NGrid_z; kg++){
-    for(k=0; k<domain_3d[kg][0][0].Nz; k++){
-      for(jg=0; jg<NGrid_y; jg++){
-        for(j=0; j<domain_3d[0][jg][0].Ny; j++){
-          for(ig=0; ig<NGrid_x; ig++){
-            for(i=0; i<domain_3d[0][0][ig].Nx; i++){
+  for(kg=0, ka=0; kg<NGrid_z; kg++){
+    for(k=0; k<domain_3d[kg][0][0].Nz; k++, ka++){
+      for(jg=0, ja=0; jg<NGrid_y; jg++){
+        for(j=0; j<domain_3d[0][jg][0].Ny; j++, ja++){
+          for(ig=0, ia=0; ig<NGrid_x; ig++){
+            for(i=0; i<domain_3d[0][0][ig].Nx; i++, ia++){
 
               fp = domain_3d[kg][jg][ig].fp;
 
@@ -439,10 +670,12 @@ static void read_write_scalar(FILE *fp_out){
                 join_error("read_write_scalar error\n");
 
               fwrite(&fdat, sizeof(float), 1, fp_out);
+              if(nlod > 0) lod_add(ia, ja, &fdat, 1);
             }
           }
         }
       }
+      if(nlod > 0) lod_plane(ka, 1);
     }
   }
 
@@ -457,15 +690,16 @@ static void read_write_vector(FILE *fp_out){
 
   FILE *fp;
   int i, j, k, ig, jg, kg, nread;
+  int ia, ja, ka; /* i, j, k in the joined grid */
   float fvec[3];
 
 
-  for(kg=0; kg<NGrid_z; kg++){
-    for(k=0; k<domain_3d[kg][0][0].Nz; k++){
-      for(jg=0; jg<NGrid_y; jg++){
-        for(j=0; j<domain_3d[0][jg][0].Ny; j++){
-          for(ig=0; ig<NGrid_x; ig++){
-            for(i=0; i<domain_3d[0][0][ig].Nx; i++){
+  for(kg=0, ka=0; kg<NGrid_z; kg++){
+    for(k=0; k<domain_3d[kg][0][0].Nz; k++, ka++){
+      for(jg=0, ja=0; jg<NGrid_y; jg++){
+        for(j=0; j<domain_3d[0][jg][0].Ny; j++, ja++){
+          for(ig=0, ia=0; ig<NGrid_x; ig++){
+            for(i=0; i<domain_3d[0][0][ig].Nx; i++, ia++){
 
               fp = domain_3d[kg][jg][ig].fp;
 
@@ -473,10 +707,38 @@ static void read_write_vector(FILE *fp_out){
                 join_error("read_write_vector error\n");
 
               fwrite(fvec, sizeof(float), 3, fp_out);
+              if(nlod > 0) lod_add(ia, ja, fvec, 3);
             }
           }
         }
       }
+      if(nlod > 0) lod_plane(ka, 3);
+    }
+  }
+
+  return;
+}
+
+
+/* ========================================================================== */
+
+
+/* Step over an array of ncomp floats per cell in every file, without
+   reading it */
+static void skip_array(int ncomp){
+
+  VTK_Domain *d;
+  int i, j, k;
+  long nbytes;
+
+  for(k=0; k<NGrid_z; k++){
+    for(j=0; j<NGrid_y; j++){
+      for(i=0; i<NGrid_x; i++){
+        d = &domain_3d[k][j][i];
+        nbytes = (long)d->Nx * d->Ny * d->Nz * ncomp * sizeof(float);
+        if(fseek(d->fp, nbytes, SEEK_CUR) != 0)
+          join_error("skip_array error in file \"%s\"\n", d->fname);
+      }
     }
   }
 
@@ -490,8 +752,7 @@ static void read_write_vector(FILE *fp_out){
 static void write_joined_vtk(const char *out_name){
   FILE *fp_out;
   int nxt, nyt, nzt; /* Total number of grid cells in each dir. */
-  int nxp, nyp, nzp;
-  int i, j, k;
+  int i, j, k, n, ncomp;
   double ox, oy, oz, dx, dy, dz;
   char type[128], variable[128], format[128];
   char t_type[128], t_variable[128], t_format[128]; /* Temporary versions */
@@ -518,31 +779,16 @@ static void write_joined_vtk(const char *out_name){
   dy = domain_3d[0][0][0].dy;
   dz = domain_3d[0][0][0].dz;
 
-  /* Count the number of grid cell corners */
-  if(nxt >= 1 && dx > 0.0) nxp = nxt+1;
-  else nxp = nxt; /* dx = 0.0 */
-
-  if(nyt >= 1 && dy > 0.0) nyp = nyt+1;
-  else nyp = nyt; /* dy = 0.0 */
-
-  if(nzt >= 1 && dz > 0.0) nzp = nzt+1;
-  else nzp = nzt; /* dz = 0.0 */
-
   /* Open the output file */
   if((fp_out = fopen(out_name,"w")) == NULL)
     join_error("Error opening the output file \"%s\"\n",out_name);
 
-  /* Write out some header information */
-  fprintf(fp_out,"# vtk DataFile Version 3.0\n");
-  /* Save the comment field from the [0][0][0] vtk domain file */
-  /* fprintf(fp_out,"Joined VTK files\n"); */
-  fprintf(fp_out,"%s\n",domain_3d[0][0][0].comment);
-  fprintf(fp_out,"BINARY\n");
-  fprintf(fp_out,"DATASET STRUCTURED_POINTS\n");
-  fprintf(fp_out,"DIMENSIONS %d %d %d\n", nxp, nyp, nzp);
-  fprintf(fp_out,"ORIGIN %e %e %e\n", ox, oy, oz);
-  fprintf(fp_out,"SPACING %e %e %e\n", dx, dy, dz);
-  fprintf(fp_out,"CELL_DATA %d\n",nxt*nyt*nzt);
+  /* Write out some header information.  Save the comment field from
+     the [0][0][0] vtk domain file */
+  write_header(fp_out, domain_3d[0][0][0].comment, nxt, nyt, nzt,
+               ox, oy, oz, dx, dy, dz);
+  lod_open(out_name, domain_3d[0][0][0].comment, nxt, nyt, nzt,
+           ox, oy, oz, dx, dy, dz);
 
   while(1){
     for(k=0; k<NGrid_z; k++){
@@ -554,6 +800,12 @@ static void write_joined_vtk(const char *out_name){
 
             if(retval == EOF){ /* Assuming no errors, we are done... */
               fclose(fp_out);
+              for(n=0; n<nlod; n++)
+                fclose(lod_fp[n]);
+              for(n=0; n<nkeep; n++)
+                if(kept[n] == 0)
+                  fprintf(stderr,"[join_vtk]: no array \"%s\" to join\n",
+                          keep[n]);
               return;
             }
 
@@ -602,20 +854,29 @@ static void write_joined_vtk(const char *out_name){
       }
     }
 
-    printf("Reading: \"%s %s %s\"\n",type,variable,format);
-
     /* Now, every file should agree that we either have SCALARS or
        VECTORS data */
+    if(strcmp(type, "SCALARS") == 0) ncomp = 1;
+    else if(strcmp(type, "VECTORS") == 0) ncomp = 3;
+    else join_error("Input type = \"%s\"\n",type);
+
+    if(!keep_array(variable)){
+      printf("Skipping: \"%s %s %s\"\n",type,variable,format);
+      skip_array(ncomp);
+      continue;
+    }
+
+    printf("Reading: \"%s %s %s\"\n",type,variable,format);
+
     fprintf(fp_out,"%s %s %s\n",type,variable,format);
-    if(strcmp(type, "SCALARS") == 0){
+    lod_array(type,variable,format);
+    if(ncomp == 1){
       fprintf(fp_out,"LOOKUP_TABLE default\n");
       read_write_scalar(fp_out);
     }
-    else if(strcmp(type, "VECTORS") == 0){
+    else{
       read_write_vector(fp_out);
     }
-    else
-      join_error("Input type = \"%s\"\n",type);
   }
 
   return;
@@ -625,6 +886,73 @@ static void write_joined_vtk(const char *out_name){
 /* ========================================================================== */
 
 
+/* Split the comma-separated list of -f into keep[] */
+static void parse_fields(const char *list){
+  const char *p, *q;
+  int n;
+
+  for(p=list, n=1; *p != '\0'; p++)
+    if(*p == ',') n++;
+
+  keep = (char **)realloc(keep, (nkeep+n)*sizeof(char *));
+  kept = (int *)realloc(kept, (nkeep+n)*sizeof(int));
+  if(keep == NULL || kept == NULL)
+    join_error("parse_fields: failed to allocate %d names\n",nkeep+n);
+
+  for(p=list; ; p=q+1){
+    for(q=p; *q != ',' && *q != '\0'; q++) ;
+    if(q > p){
+      if((keep[nkeep] = (char *)malloc(q-p+1)) == NULL)
+        join_error("parse_fields: failed to allocate %d\n",(int)(q-p+1));
+      memcpy(keep[nkeep], p, q-p);
+      keep[nkeep][q-p] = '\0';
+      kept[nkeep] = 0;
+      nkeep++;
+    }
+    if(*q == '\0') break;
+  }
+
+  return;
+}
+
+
+/* Split the comma-separated factors of -l into lod_factor[] */
+static void parse_lod(const char *list){
+  const char *p;
+
+  for(p=list; p != NULL; p=strchr(p, ',')){
+    if(*p == ',') p++;
+    if(nlod == MAX_LOD)
+      join_error("-l: at most %d factors\n",MAX_LOD);
+    if((lod_factor[nlod] = atoi(p)) < 2)
+      join_error("-l: factors are 2 or more, not \"%s\"\n",p);
+    nlod++;
+  }
+
+  return;
+}
+
+
+/* Is this array one to join? */
+static int keep_array(const char *variable){
+  int n;
+
+  if(nkeep == 0) return 1;
+
+  for(n=0; n<nkeep; n++){
+    if(strcmp(variable, keep[n]) == 0){
+      kept[n]++;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/* ========================================================================== */
+
+
 static char *my_strdup(const char *in){
   char *out = (char *)malloc((1+strlen(in))*sizeof(char));
   if(out == NULL) {